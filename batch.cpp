@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "batch.h"
+#include "headless.h"
+#include "recorder.h"
+
+// the frame count of a dump is in its header
+static long frameCount(const char *input) {
+    if (isRawPath(input)) {
+        RawReplay replay;
+        if (!openRawReplay(&replay, input)) return -1;
+        long count = replay.count;
+        closeRawReplay(&replay);
+        return count;
+    }
+    cv::VideoCapture cap;
+    if (!openSource(input, cap)) {
+        fprintf(stderr, "could not open %s\n", input);
+        return -1;
+    }
+    return std::max(0L, (long) cap.get(cv::CAP_PROP_FRAME_COUNT));
+}
+
+static bool planSegments(const char *input, const std::string &output, int segments,
+                         std::vector<BatchJob> *jobs) {
+    long total = frameCount(input);
+    if (total < 0) return false;
+    if (total <= 0) {
+        // live streams and some containers cannot be seeked, process them whole
+        jobs->push_back({input, output, 0, -1});
+        return true;
+    }
+
+    // the cuts need not land on keyframes: runJob checks where every seek ends up and decodes up to the
+    // segment's first frame when it is off, so segments neither overlap nor leave gaps; a dump is indexed exactly
+    long length = (total + segments - 1) / segments;
+    for (int i = 0; i * length < total; i++) {
+        std::string part = output.empty() ? output : numberedPath(output, i);
+        jobs->push_back({input, part, i * length, length});
+    }
+    return true;
+}
+
+static bool writeConcatList(const std::string &output, const std::vector<BatchJob> &jobs) {
+    std::string listPath = output + ".txt";
+    FILE *list = fopen(listPath.c_str(), "w");
+    if (list == nullptr) return false;
+    for (const BatchJob &job : jobs) {
+        // the concat demuxer resolves relative names against the list itself
+        size_t slash = job.output.find_last_of('/');
+        fprintf(list, "file '%s'\n", job.output.substr(slash == std::string::npos ? 0 : slash + 1).c_str());
+    }
+    fclose(list);
+    printf("segments listed in %s, stitch with: ffmpeg -f concat -safe 0 -i %s -c copy %s\n",
+           listPath.c_str(), listPath.c_str(), output.c_str());
+    return true;
+}
+
+// Moves cap to frame first. Containers that seek by timestamp can land a frame or
+// more away, so the position is read back, and when it is not the one asked for
+// the input is opened again and decoded forward up to it.
+static bool seekFrame(cv::VideoCapture &cap, const char *input, long first) {
+    if (first <= 0) return true;
+    cap.set(cv::CAP_PROP_POS_FRAMES, (double) first);
+    long landed = std::lround(cap.get(cv::CAP_PROP_POS_FRAMES));
+    if (landed == first) return true;
+
+    fprintf(stderr, "seeking %s to frame %ld landed on %ld, decoding up to it instead\n", input, first, landed);
+    cap.release();
+    if (!openSource(input, cap)) return false;
+    for (long frame = 0; frame < first; frame++) {
+        if (!cap.grab()) return false;
+    }
+    return true;
+}
+
+static long runJob(const BatchJob &job, const RecorderSettings &settings, Backend backend, Algorithms toggles,
+                   ProcessingParameters parameters, Profiler *profiler) {
+    RecorderSettings output = settings;
+    output.path = job.output.empty() ? nullptr : job.output.c_str();
+    cv::VideoCapture cap;
+    if (isRawPath(job.input.c_str())) {
+        RawReplay replay;
+        if (!openRawReplay(&replay, job.input.c_str())) return -1;
+        replay.position = job.firstFrame;
+        long frames = processStream(cap, &replay, output, replayFps(settings, &replay), job.frameCount, backend,
+                                    toggles, parameters, profiler);
+        closeRawReplay(&replay);
+        return frames;
+    }
+    if (!openSource(job.input.c_str(), cap)) {
+        fprintf(stderr, "could not open %s\n", job.input.c_str());
+        return -1;
+    }
+    if (!seekFrame(cap, job.input.c_str(), job.firstFrame)) {
+        fprintf(stderr, "could not reach frame %ld of %s\n", job.firstFrame, job.input.c_str());
+        return -1;
+    }
+    return processStream(cap, nullptr, output, recordingFps(settings, cap), job.frameCount, backend, toggles,
+                         parameters, profiler);
+}
+
+int runBatch(const Options &options, Backend backend, Algorithms toggles, ProcessingParameters parameters,
+             Profiler *profiler) {
+    int workers = options.jobs > 0 ? options.jobs : cv::getNumberOfCPUs();
+    std::string output = options.recorder.path != nullptr ? options.recorder.path : "";
+
+    std::vector<BatchJob> jobs;
+    bool segmented = options.inputs.size() <= 1;
+    if (segmented) {
+        int segments = options.segments > 0 ? options.segments : workers;
+        if (!planSegments(options.input, output, segments, &jobs)) return 1;
+    } else {
+        for (size_t i = 0; i < options.inputs.size(); i++) {
+            jobs.push_back({options.inputs[i], output.empty() ? output : numberedPath(output, (int) i), 0, -1});
+        }
+    }
+    if (workers > (int) jobs.size()) workers = (int) jobs.size();
+
+    // the jobs are the parallelism now, OpenCV spreading each call over every core would oversubscribe
+    if (workers > 1) cv::setNumThreads(1);
+
+    std::atomic<size_t> next(0);
+    std::atomic<long> frames(0);
+    std::atomic<bool> failed(false);
+    int64 start = cv::getTickCount();
+
+    std::vector<std::thread> pool;
+    for (int w = 0; w < workers; w++) {
+        pool.emplace_back([&] {
+            for (size_t i = next++; i < jobs.size(); i = next++) {
+                long done = runJob(jobs[i], options.recorder, backend, toggles, parameters, profiler);
+                if (done < 0) failed = true;
+                else frames += done;
+            }
+        });
+    }
+    for (std::thread &worker : pool) worker.join();
+
+    double seconds = (double) (cv::getTickCount() - start) / cv::getTickFrequency();
+    printf("%ld frames in %.2f s (%.1f fps) on %d workers\n", frames.load(), seconds,
+           seconds > 0 ? frames / seconds : 0.0, workers);
+
+    if (failed) return 1;
+    if (segmented && jobs.size() > 1 && !output.empty() && !writeConcatList(output, jobs)) {
+        fprintf(stderr, "could not write the segment list for %s\n", output.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef OVP_BATCH_H
+#define OVP_BATCH_H
+
+#include <string>
+#include "options.h"
+#include "processing.h"
+#include "profiler.h"
+
+// A contiguous run of frames of one input, processed on its own by one worker.
+typedef struct batchJob {
+    std::string input;
+    std::string output; // empty to discard the frames
+    long firstFrame;
+    long frameCount;    // negative to run to the end of the input
+} BatchJob;
+
+// Headless processing on a pool of options.jobs workers. Several inputs become one
+// job each, written to numbered outputs; a single seekable input is split into
+// options.segments pieces written to numbered parts, plus a concat list that
+// stitches them in order without re-encoding:
+//     ffmpeg -f concat -safe 0 -i <output>.txt -c copy <output>
+// Returns the process exit code.
+int runBatch(const Options &options, Backend backend, Algorithms toggles, ProcessingParameters parameters,
+             Profiler *profiler);
+
+#endif //OVP_BATCH_H
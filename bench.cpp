@@ -0,0 +1,168 @@
+// Throughput of every stage of applyProcessing and of representative combinations,
+// across resolutions, channel counts, Gaussian kernel sizes and backends.
+// Frames are synthetic unless OVP_BENCH_INPUT names an image, a video or a raw
+// dump, whose first frame is then scaled to every resolution.
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <opencv2/opencv.hpp>
+#include "processing.h"
+#include "options.h"
+#include "rawfile.h"
+
+typedef struct benchCase {
+    std::string name;
+    const char *toggles; // same spec as --toggles
+    int gaussianSize;
+    int ordering;
+} BenchCase;
+
+typedef struct benchResolution {
+    const char *name;
+    cv::Size size;
+} BenchResolution;
+
+static const BenchResolution resolutions[] = {
+        {"480p",  cv::Size(640, 480)},
+        {"720p",  cv::Size(1280, 720)},
+        {"1080p", cv::Size(1920, 1080)},
+        {"4k",    cv::Size(3840, 2160)},
+};
+
+static const int gaussianSizes[] = {3, 7, 15, 31, 51, 101};
+
+static std::vector<BenchCase> benchCases() {
+    std::vector<BenchCase> cases;
+    for (int size : gaussianSizes) {
+        cases.push_back({"gaussian" + std::to_string(size), "gaussian", size, ORDER_AS_WRITTEN});
+    }
+    for (int size : gaussianSizes) {
+        cases.push_back({"boxblur" + std::to_string(size), "gaussian,boxblur", size, ORDER_AS_WRITTEN});
+    }
+    cases.push_back({"canny", "canny", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"sobel", "sobel", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"sobel_l2", "sobel,l2", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"sobel16", "sobel,sobel16", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"point", "brightness,contrast,negative", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"grayscale", "grayscale", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"halve", "halfx,halfy", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"rotate", "rotate=1", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"mirror", "mirrorx,mirrory", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"geometry", "halfx,halfy,rotate=1,mirrorx", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"gaussian_canny", "gaussian,canny", 5, ORDER_AS_WRITTEN});
+    cases.push_back({"edges", "gaussian,canny,sobel", 5, ORDER_AS_WRITTEN});
+    cases.push_back({"edges_shared", "gaussian,canny,sobel,shared", 5, ORDER_AS_WRITTEN});
+    cases.push_back({"gray_half_canny", "grayscale,halfx,halfy,canny", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"gray_half", "grayscale,halfx,halfy", 3, ORDER_AS_WRITTEN});
+    cases.push_back({"gray_half_canny_fixed", "grayscale,halfx,halfy,canny", 3, ORDER_APPROXIMATE});
+    cases.push_back({"gaussian_canny_luma", "gaussian,canny", 5, ORDER_APPROXIMATE});
+    cases.push_back({"everything", "gaussian,brightness,contrast,negative,grayscale,halfx,halfy,rotate=3,mirrorx",
+                     15, ORDER_AS_WRITTEN});
+    cases.push_back({"everything_reordered",
+                     "gaussian,brightness,contrast,negative,grayscale,halfx,halfy,rotate=3,mirrorx",
+                     15, ORDER_APPROXIMATE});
+    cases.push_back({"edges_striped", "gaussian,canny,sobel,stripes=8", 5, ORDER_AS_WRITTEN});
+    cases.push_back({"everything_striped",
+                     "gaussian,brightness,contrast,negative,grayscale,halfx,halfy,rotate=3,mirrorx,stripes=8",
+                     15, ORDER_AS_WRITTEN});
+    return cases;
+}
+
+// Smooth random structure with sharp block edges, so the filters see both.
+static cv::Mat syntheticFrame(cv::Size size, int channels) {
+    cv::Mat coarse(size.height / 16, size.width / 16, CV_MAKETYPE(CV_8U, channels));
+    cv::RNG rng(42);
+    rng.fill(coarse, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat frame;
+    cv::resize(coarse, frame, size, 0, 0, cv::INTER_NEAREST);
+    cv::GaussianBlur(frame, frame, cv::Size(5, 5), 0);
+    return frame;
+}
+
+static cv::Mat benchFrame(cv::Size size, int channels) {
+    const char *input = getenv("OVP_BENCH_INPUT");
+    if (input == nullptr) return syntheticFrame(size, channels);
+
+    cv::Mat recorded;
+    cv::VideoCapture cap;
+    RawReplay replay;
+    if (isRawPath(input)) {
+        // the header over the mapping is only good until it is closed
+        if (openRawReplay(&replay, input) && rawFrame(&replay, 0, &recorded)) recorded = recorded.clone();
+        closeRawReplay(&replay);
+    } else if (cap.open(input)) {
+        cap >> recorded;
+    }
+    if (recorded.empty()) recorded = cv::imread(input);
+    if (recorded.empty()) return syntheticFrame(size, channels);
+
+    cv::Mat frame;
+    cv::resize(recorded, frame, size, 0, 0, cv::INTER_AREA);
+    if (channels == 1) cv::cvtColor(frame, frame, cv::COLOR_BGR2GRAY);
+    return frame;
+}
+
+static void upload(const cv::Mat &src, cv::Mat *dst) {
+    *dst = src;
+}
+
+static void upload(const cv::Mat &src, cv::UMat *dst) {
+    src.copyTo(*dst);
+}
+
+// device work is asynchronous, wait for it so every iteration is measured in full
+static void finish(const cv::Mat &) {}
+
+static void finish(const cv::UMat &) {
+    cv::ocl::finish();
+}
+
+template<typename M>
+static void runCase(benchmark::State &state, BenchCase benchCase, cv::Size size, int channels) {
+    Algorithms toggles = {true, false};
+    parseToggles(benchCase.toggles, &toggles);
+    toggles.ordering = benchCase.ordering;
+    ProcessingParameters parameters = {benchCase.gaussianSize, 255, 300, 120};
+
+    cv::Mat host = benchFrame(size, channels);
+    M input;
+    M frame;
+    FrameBuffersOf<M> buffers;
+    upload(host, &input);
+
+    // the first call sizes the buffers and builds the remap tables
+    applyProcessing(toggles, parameters, input, &frame, &buffers);
+    finish(frame);
+
+    for (auto _ : state) {
+        applyProcessing(toggles, parameters, input, &frame, &buffers);
+        finish(frame);
+    }
+
+    state.SetBytesProcessed((int64_t) state.iterations() * (int64_t) (host.total() * host.elemSize()));
+    state.counters["fps"] = benchmark::Counter((double) state.iterations(), benchmark::Counter::kIsRate);
+}
+
+int main(int argc, char **argv) {
+    bool opencl = useBackend(BACKEND_OPENCL);
+    for (const BenchCase &benchCase : benchCases()) {
+        for (const BenchResolution &resolution : resolutions) {
+            for (int channels : {1, 3}) {
+                std::string name = benchCase.name + "/" + resolution.name + "/c" + std::to_string(channels);
+                benchmark::RegisterBenchmark((name + "/cpu").c_str(), runCase<cv::Mat>, benchCase,
+                                             resolution.size, channels)->Unit(benchmark::kMillisecond);
+                if (opencl) {
+                    benchmark::RegisterBenchmark((name + "/opencl").c_str(), runCase<cv::UMat>, benchCase,
+                                                 resolution.size, channels)->Unit(benchmark::kMillisecond);
+                }
+            }
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "capture.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+// retries the requests a signal interrupted
+static int control(int fd, unsigned long request, void *argument) {
+    int result;
+    do result = ioctl(fd, request, argument);
+    while (result == -1 && errno == EINTR);
+    return result;
+}
+
+static bool queueBuffer(NativeCapture *capture, int index) {
+    v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = index;
+    return control(capture->fd, VIDIOC_QBUF, &buffer) == 0;
+}
+
+// Negotiates the pixel format and frame rate, keeping the size the driver is set to.
+static bool negotiate(NativeCapture *capture, const std::string &path) {
+    unsigned int fourcc = capture->format == PIXELS_NV12 ? V4L2_PIX_FMT_NV12 : V4L2_PIX_FMT_YUYV;
+    v4l2_format format;
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (control(capture->fd, VIDIOC_G_FMT, &format) != 0) {
+        fprintf(stderr, "%s is not a capture device\n", path.c_str());
+        return false;
+    }
+    format.fmt.pix.pixelformat = fourcc;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    if (control(capture->fd, VIDIOC_S_FMT, &format) != 0 || format.fmt.pix.pixelformat != fourcc) {
+        fprintf(stderr, "%s cannot deliver %s frames\n", path.c_str(),
+                capture->format == PIXELS_NV12 ? "NV12" : "YUYV");
+        return false;
+    }
+    capture->size = cv::Size(format.fmt.pix.width, format.fmt.pix.height);
+    capture->stride = format.fmt.pix.bytesperline;
+    if (capture->stride == 0) capture->stride = capture->size.width * (capture->format == PIXELS_YUYV ? 2 : 1);
+
+    v4l2_streamparm stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (control(capture->fd, VIDIOC_G_PARM, &stream) == 0 && stream.parm.capture.timeperframe.numerator > 0) {
+        capture->fps = (double) stream.parm.capture.timeperframe.denominator /
+                       stream.parm.capture.timeperframe.numerator;
+    }
+    return true;
+}
+
+// Maps the driver buffers, queues all of them and starts streaming.
+static bool mapBuffers(NativeCapture *capture, const std::string &path) {
+    v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(request));
+    request.count = NATIVE_BUFFERS;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    if (control(capture->fd, VIDIOC_REQBUFS, &request) != 0 || request.count < 2) {
+        fprintf(stderr, "%s cannot share its buffers\n", path.c_str());
+        return false;
+    }
+
+    int count = std::min((int) request.count, NATIVE_BUFFERS);
+    for (int i = 0; i < count; i++) {
+        v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+        if (control(capture->fd, VIDIOC_QUERYBUF, &buffer) != 0) return false;
+        void *start = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, capture->fd, buffer.m.offset);
+        if (start == MAP_FAILED) {
+            fprintf(stderr, "could not map the buffers of %s: %s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+        capture->starts[i] = start;
+        capture->lengths[i] = buffer.length;
+        capture->count++;
+        if (!queueBuffer(capture, i)) return false;
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (control(capture->fd, VIDIOC_STREAMON, &type) != 0) {
+        fprintf(stderr, "%s does not start streaming: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool openNative(NativeCapture *capture, const char *device, PixelFormat format) {
+    std::string path = device;
+    if (path.find('/') == std::string::npos) path = "/dev/video" + path;
+    capture->format = format;
+    capture->fps = 0;
+    capture->count = 0;
+    capture->lent = -1;
+    capture->fd = open(path.c_str(), O_RDWR);
+    if (capture->fd < 0) {
+        fprintf(stderr, "could not open %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    if (!negotiate(capture, path) || !mapBuffers(capture, path)) {
+        closeNative(capture);
+        return false;
+    }
+    return true;
+}
+
+bool nativeFrame(NativeCapture *capture, bool luma, bool keep, cv::Mat *frame) {
+    // the previous frame pointed into this one, and the caller is done with it by now
+    if (capture->lent >= 0) {
+        queueBuffer(capture, capture->lent);
+        capture->lent = -1;
+    }
+
+    v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    if (control(capture->fd, VIDIOC_DQBUF, &buffer) != 0) return false;
+
+    uchar *data = (uchar *) capture->starts[buffer.index];
+    if (capture->format == PIXELS_YUYV) {
+        cv::Mat packed(capture->size, CV_8UC2, data, capture->stride);
+        if (luma) cv::extractChannel(packed, *frame, 0);
+        else cv::cvtColor(packed, *frame, cv::COLOR_YUV2BGR_YUYV);
+    } else {
+        // the chroma rows follow the luma ones with the same stride
+        cv::Mat planes(capture->size.height * 3 / 2, capture->size.width, CV_8UC1, data, capture->stride);
+        if (luma && !keep) {
+            *frame = planes.rowRange(0, capture->size.height);
+            capture->lent = buffer.index;
+            return true;
+        }
+        if (luma) planes.rowRange(0, capture->size.height).copyTo(*frame);
+        else cv::cvtColor(planes, *frame, cv::COLOR_YUV2BGR_NV12);
+    }
+    return queueBuffer(capture, buffer.index);
+}
+
+void closeNative(NativeCapture *capture) {
+    if (capture->fd < 0) return;
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    control(capture->fd, VIDIOC_STREAMOFF, &type);
+    for (int i = 0; i < capture->count; i++) munmap(capture->starts[i], capture->lengths[i]);
+    capture->count = 0;
+    capture->lent = -1;
+    close(capture->fd);
+    capture->fd = -1;
+}
+
+#else
+
+bool openNative(NativeCapture *capture, const char *, PixelFormat) {
+    capture->fd = -1;
+    fprintf(stderr, "native capture needs V4L2, which only Linux has\n");
+    return false;
+}
+
+bool nativeFrame(NativeCapture *, bool, bool, cv::Mat *) {
+    return false;
+}
+
+void closeNative(NativeCapture *) {}
+
+#endif
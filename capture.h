@@ -0,0 +1,42 @@
+#ifndef OVP_CAPTURE_H
+#define OVP_CAPTURE_H
+
+#include <opencv2/opencv.hpp>
+
+typedef enum pixelFormat {
+    PIXELS_DEFAULT, // through cv::VideoCapture, which hands over BGR
+    PIXELS_YUYV,    // packed 4:2:2, Y U Y V for every two pixels
+    PIXELS_NV12     // 4:2:0, the whole Y plane followed by interleaved U and V at half resolution
+} PixelFormat;
+
+#define NATIVE_BUFFERS 4 // driver buffers mapped and kept queued
+
+// A V4L2 camera read straight from the driver buffers mapped into our address
+// space, in the pixel format the camera produces, instead of going through the
+// copy and colour conversion cv::VideoCapture makes of every frame.
+typedef struct nativeCapture {
+    int fd;
+    PixelFormat format;
+    cv::Size size;
+    size_t stride;  // bytes per row of the Y plane
+    double fps;     // as negotiated with the driver, 0 if it does not say
+    int count;      // buffers mapped
+    void *starts[NATIVE_BUFFERS];
+    size_t lengths[NATIVE_BUFFERS];
+    int lent;       // buffer the last frame points into, -1 when it is back with the driver
+} NativeCapture;
+
+// Opens a device, "/dev/videoN" or just N, and starts streaming in format at
+// the size the driver is set to. Prints the problem and returns false when it
+// cannot deliver that format.
+bool openNative(NativeCapture *capture, const char *device, PixelFormat format);
+
+// Waits for the next frame and puts in *frame its Y plane when luma is set, or
+// the frame converted to BGR. An NV12 Y plane is a header over the driver
+// buffer, valid until the next call; keep copies it out instead. Returns false
+// when the device stops streaming.
+bool nativeFrame(NativeCapture *capture, bool luma, bool keep, cv::Mat *frame);
+
+void closeNative(NativeCapture *capture);
+
+#endif //OVP_CAPTURE_H
@@ -0,0 +1,333 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include "framebus.h"
+
+#define BUS_PAGE 4096
+
+static uchar *slotData(BusLayout *bus, uint64_t frame) {
+    return (uchar *) bus + bus->dataOffset + (frame % BUS_SLOTS) * bus->slotBytes;
+}
+
+#ifdef __linux__
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t pageRound(size_t bytes) {
+    return (bytes + BUS_PAGE - 1) / BUS_PAGE * BUS_PAGE;
+}
+
+static void unmapPublisher(FramePublisher *publisher) {
+    if (publisher->bus == nullptr) return;
+    // consumers still mapping it follow the name to the next one
+    publisher->bus->retired.store(1, std::memory_order_release);
+    munmap(publisher->bus, publisher->length);
+    close(publisher->fd);
+    shm_unlink(publisher->name.c_str());
+    publisher->bus = nullptr;
+}
+
+// Creates the segment with slots of at least frameBytes, replacing any older one of the same name.
+static bool createSegment(FramePublisher *publisher, size_t frameBytes) {
+    unmapPublisher(publisher);
+    shm_unlink(publisher->name.c_str()); // left behind by a publisher that did not exit cleanly
+    size_t dataOffset = pageRound(sizeof(BusLayout));
+    size_t slotBytes = pageRound(frameBytes);
+    size_t length = dataOffset + BUS_SLOTS * slotBytes;
+
+    publisher->fd = shm_open(publisher->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (publisher->fd < 0 || ftruncate(publisher->fd, (off_t) length) != 0) {
+        fprintf(stderr, "could not create the frame bus %s: %s\n", publisher->name.c_str(), strerror(errno));
+        if (publisher->fd >= 0) {
+            close(publisher->fd);
+            shm_unlink(publisher->name.c_str());
+        }
+        return false;
+    }
+    void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, publisher->fd, 0);
+    if (memory == MAP_FAILED) {
+        fprintf(stderr, "could not map the frame bus %s: %s\n", publisher->name.c_str(), strerror(errno));
+        close(publisher->fd);
+        shm_unlink(publisher->name.c_str());
+        return false;
+    }
+
+    // the segment starts zeroed, which is every atomic at 0 and every consumer entry free
+    auto bus = (BusLayout *) memory;
+    bus->slotBytes = slotBytes;
+    bus->dataOffset = dataOffset;
+    bus->published.store(publisher->published, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(bus->magic, BUS_MAGIC, sizeof(bus->magic)); // last, so a consumer that sees it sees the rest
+    publisher->bus = bus;
+    publisher->length = length;
+    return true;
+}
+
+#else
+
+static void unmapPublisher(FramePublisher *) {}
+
+static bool createSegment(FramePublisher *publisher, size_t) {
+    fprintf(stderr, "the frame bus %s needs POSIX shared memory, which only the Linux build uses\n",
+            publisher->name.c_str());
+    return false;
+}
+
+#endif
+
+void openPublisher(FramePublisher *publisher, const std::string &name) {
+    publisher->name = name;
+    publisher->fd = -1;
+    publisher->bus = nullptr;
+    publisher->length = 0;
+    publisher->published = 0;
+    publisher->failed = false;
+}
+
+bool publishFrame(FramePublisher *publisher, cv::InputArray frame, int64 grabbed) {
+    if (publisher->failed) return false;
+    if (frame.empty()) return true;
+    cv::Size size = frame.size();
+    int type = frame.type();
+    size_t bytes = (size_t) size.area() * CV_ELEM_SIZE(type);
+    if (publisher->bus == nullptr || bytes > publisher->bus->slotBytes) {
+        if (!createSegment(publisher, bytes)) {
+            publisher->failed = true;
+            return false;
+        }
+    }
+
+    BusLayout *bus = publisher->bus;
+    uint64_t next = publisher->published + 1;
+    BusSlot *slot = &bus->slots[next % BUS_SLOTS];
+    slot->sequence.store(2 * next - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->width = size.width;
+    slot->height = size.height;
+    slot->type = type;
+    slot->grabbed = grabbed;
+    cv::Mat target(size, type, slotData(bus, next));
+    frame.copyTo(target); // same size and type, so written in place
+    slot->sequence.store(2 * next, std::memory_order_release);
+    bus->published.store(next, std::memory_order_release);
+    publisher->published = next;
+    return true;
+}
+
+void closePublisher(FramePublisher *publisher) {
+    unmapPublisher(publisher);
+}
+
+void openFrameBus(FrameBus *bus, const char *name) {
+    std::string base = name[0] == '/' ? name : std::string("/") + name;
+    openPublisher(&bus->captured, base + ".captured");
+    openPublisher(&bus->processed, base + ".processed");
+}
+
+bool publishFrames(FrameBus *bus, cv::InputArray captured, cv::InputArray processed, int64 grabbed) {
+    bool published = publishFrame(&bus->captured, captured, grabbed);
+    return publishFrame(&bus->processed, processed, grabbed) && published;
+}
+
+static void reportConsumers(const FramePublisher *publisher) {
+    if (publisher->failed) {
+        fprintf(stderr, "%s failed after %lu frames\n", publisher->name.c_str(), (unsigned long) publisher->published);
+    }
+    if (publisher->bus == nullptr) return;
+    for (int i = 0; i < BUS_CONSUMERS; i++) {
+        const BusConsumer &consumer = publisher->bus->consumers[i];
+        int pid = consumer.pid.load(std::memory_order_relaxed);
+        if (pid == 0) continue;
+        uint64_t cursor = consumer.cursor.load(std::memory_order_relaxed);
+        printf("%s: process %d is %lu frames behind\n", publisher->name.c_str(), pid,
+               (unsigned long) (publisher->published - std::min(cursor, publisher->published)));
+    }
+}
+
+void closeFrameBus(FrameBus *bus) {
+    printf("published %lu frames on %s and %s\n", (unsigned long) bus->processed.published,
+           bus->captured.name.c_str(), bus->processed.name.c_str());
+    reportConsumers(&bus->captured);
+    reportConsumers(&bus->processed);
+    closePublisher(&bus->captured);
+    closePublisher(&bus->processed);
+}
+
+#ifdef __linux__
+
+// Takes a free consumer entry, or one whose process is gone.
+static bool attachConsumer(FrameConsumer *consumer) {
+    int self = getpid();
+    for (int i = 0; i < BUS_CONSUMERS; i++) {
+        BusConsumer &entry = consumer->bus->consumers[i];
+        int32_t pid = entry.pid.load(std::memory_order_relaxed);
+        bool free = pid == 0 || (kill(pid, 0) != 0 && errno == ESRCH);
+        if (free && entry.pid.compare_exchange_strong(pid, self)) {
+            entry.cursor.store(consumer->cursor, std::memory_order_relaxed);
+            consumer->index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool mapConsumer(FrameConsumer *consumer) {
+    consumer->fd = shm_open(consumer->name.c_str(), O_RDWR, 0);
+    struct stat segment;
+    if (consumer->fd < 0 || fstat(consumer->fd, &segment) != 0 || (size_t) segment.st_size < sizeof(BusLayout)) {
+        if (consumer->fd >= 0) close(consumer->fd);
+        consumer->fd = -1;
+        return false;
+    }
+    consumer->length = (size_t) segment.st_size;
+    void *memory = mmap(nullptr, consumer->length, PROT_READ | PROT_WRITE, MAP_SHARED, consumer->fd, 0);
+    consumer->bus = memory == MAP_FAILED ? nullptr : (BusLayout *) memory;
+    if (consumer->bus != nullptr && memcmp(consumer->bus->magic, BUS_MAGIC, sizeof(consumer->bus->magic)) == 0) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (attachConsumer(consumer)) return true;
+    }
+    closeConsumer(consumer);
+    return false;
+}
+
+void closeConsumer(FrameConsumer *consumer) {
+    if (consumer->bus != nullptr) {
+        if (consumer->index >= 0) consumer->bus->consumers[consumer->index].pid.store(0, std::memory_order_relaxed);
+        munmap(consumer->bus, consumer->length);
+    }
+    if (consumer->fd >= 0) close(consumer->fd);
+    consumer->bus = nullptr;
+    consumer->fd = -1;
+    consumer->index = -1;
+}
+
+#else
+
+// publishers never get to create a segment here
+static bool mapConsumer(FrameConsumer *consumer) {
+    consumer->fd = -1;
+    return false;
+}
+
+void closeConsumer(FrameConsumer *consumer) {
+    consumer->bus = nullptr;
+    consumer->fd = -1;
+    consumer->index = -1;
+}
+
+#endif
+
+bool openConsumer(FrameConsumer *consumer, const char *name) {
+    consumer->name = name[0] == '/' ? name : std::string("/") + name;
+    consumer->bus = nullptr;
+    consumer->index = -1;
+    consumer->lost = 0;
+    consumer->cursor = 0;
+    if (!mapConsumer(consumer)) return false;
+    // start from the newest frame rather than from whatever the ring still holds
+    uint64_t published = consumer->bus->published.load(std::memory_order_acquire);
+    consumer->cursor = published > 0 ? published - 1 : 0;
+    consumer->bus->consumers[consumer->index].cursor.store(consumer->cursor, std::memory_order_relaxed);
+    return true;
+}
+
+bool nextBusFrame(FrameConsumer *consumer, cv::Mat *frame, uint64_t *sequence, int64 *grabbed) {
+    if (consumer->bus == nullptr || consumer->bus->retired.load(std::memory_order_acquire)) {
+        // the publisher grew the slots, or restarted: follow the name, keeping the cursor
+        uint64_t cursor = consumer->cursor;
+        closeConsumer(consumer);
+        consumer->cursor = cursor;
+        if (!mapConsumer(consumer)) return false;
+    }
+
+    BusLayout *bus = consumer->bus;
+    while (true) {
+        uint64_t published = bus->published.load(std::memory_order_acquire);
+        if (published <= consumer->cursor) return false;
+
+        // the slot after the newest may be being written already
+        uint64_t next = consumer->cursor + 1;
+        uint64_t oldest = published >= BUS_SLOTS - 1 ? published - (BUS_SLOTS - 2) : 1;
+        if (next < oldest) {
+            consumer->lost += (long) (oldest - next);
+            next = oldest;
+        }
+
+        BusSlot *slot = &bus->slots[next % BUS_SLOTS];
+        uint64_t expected = 2 * next;
+        uint64_t before = slot->sequence.load(std::memory_order_acquire);
+        if (before == expected) {
+            cv::Mat shared(slot->height, slot->width, slot->type, slotData(bus, next));
+            int64 captured = slot->grabbed;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot->sequence.load(std::memory_order_relaxed) == expected) {
+                *frame = shared;
+                *grabbed = captured;
+                *sequence = expected;
+                consumer->cursor = next;
+                bus->consumers[consumer->index].cursor.store(next, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        // lapped while reading it: the frame is gone, move on to the next
+        consumer->lost++;
+        consumer->cursor = next;
+    }
+}
+
+bool busFrameIntact(const FrameConsumer *consumer, uint64_t sequence) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const BusSlot &slot = consumer->bus->slots[(sequence / 2) % BUS_SLOTS];
+    return slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+int readFrameBus(const char *name) {
+    FrameConsumer consumer;
+    double frequency = cv::getTickFrequency();
+    int64 waiting = cv::getTickCount();
+    while (!openConsumer(&consumer, name)) {
+        if (cv::getTickCount() - waiting > BUS_WAIT * frequency) {
+            fprintf(stderr, "no publisher on %s\n", name);
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    printf("reading %s\n", consumer.name.c_str());
+
+    cv::Mat frame;
+    cv::Mat copy;
+    uint64_t sequence = 0;
+    int64 grabbed;
+    long read = 0;
+    long torn = 0; // overwritten while being copied
+    int64 seen = cv::getTickCount();
+    int64 reported = seen;
+    while (true) {
+        int64 now = cv::getTickCount();
+        if (nextBusFrame(&consumer, &frame, &sequence, &grabbed)) {
+            frame.copyTo(copy);
+            if (busFrameIntact(&consumer, sequence)) read++;
+            else torn++;
+            seen = now;
+        } else if (now - seen > BUS_WAIT * frequency) {
+            break;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(BUS_POLL_MS));
+        }
+        if (now - reported >= frequency) {
+            printf("frame %lu, %ld read, %ld lost\n", (unsigned long) (sequence / 2), read, consumer.lost + torn);
+            reported = now;
+        }
+    }
+    printf("read %ld frames of %s up to frame %lu, lost %ld\n", read, consumer.name.c_str(),
+           (unsigned long) (sequence / 2), consumer.lost + torn);
+    closeConsumer(&consumer);
+    return 0;
+}
+
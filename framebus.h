@@ -0,0 +1,115 @@
+#ifndef OVP_FRAMEBUS_H
+#define OVP_FRAMEBUS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+#define BUS_MAGIC "OVPBUS01"
+#define BUS_SLOTS 8       // frames kept; a consumer further behind than that loses the oldest
+#define BUS_CONSUMERS 16  // consumers attached to one bus at a time
+#define BUS_WAIT 10       // seconds readFrameBus waits for a publisher, or for its next frame, before giving up
+#define BUS_POLL_MS 1     // sleep of readFrameBus between looks at a ring with nothing new
+
+// One frame of the ring. sequence works as a seqlock: odd while frame n is
+// being written, 2n once it is complete, so a reader knows whether what it
+// read is still frame n without ever taking a lock.
+typedef struct busSlot {
+    std::atomic<uint64_t> sequence;
+    int32_t width;
+    int32_t height;
+    int32_t type;     // cv::Mat type
+    int32_t reserved;
+    int64_t grabbed;  // tick count the frame was captured at
+} BusSlot;
+
+typedef struct busConsumer {
+    std::atomic<int32_t> pid;      // of the process holding the entry, 0 when free
+    std::atomic<uint64_t> cursor;  // last frame it read, for the publisher to report lag
+} BusConsumer;
+
+// Start of the shared memory segment, followed at dataOffset by BUS_SLOTS
+// frames of slotBytes each.
+typedef struct busLayout {
+    char magic[8];
+    uint64_t slotBytes;
+    uint64_t dataOffset;
+    std::atomic<uint32_t> retired;    // the publisher moved on to a segment with larger slots under the same name
+    std::atomic<uint64_t> published;  // frames completed so far
+    BusSlot slots[BUS_SLOTS];
+    BusConsumer consumers[BUS_CONSUMERS];
+} BusLayout;
+
+// Writes frames into a POSIX shared memory ring other processes on the host
+// map too. Publishing never waits for them: the oldest slot is overwritten
+// whatever the consumers are doing.
+typedef struct framePublisher {
+    std::string name; // of the segment, starting with '/'
+    int fd;
+    BusLayout *bus;
+    size_t length;
+    uint64_t published;
+    bool failed;      // the segment could not be created, said once and never tried again
+} FramePublisher;
+
+// Maps a bus a publisher created and takes a consumer entry in it.
+typedef struct frameConsumer {
+    std::string name;
+    int fd;
+    BusLayout *bus;
+    size_t length;
+    int index;       // of the consumer entry
+    uint64_t cursor; // last frame handed out
+    long lost;       // frames overwritten before this consumer got to them
+} FrameConsumer;
+
+// The captured and the processed frames, published as <name>.captured and
+// <name>.processed.
+typedef struct frameBus {
+    FramePublisher captured;
+    FramePublisher processed;
+} FrameBus;
+
+// The segment is only created with the first frame, sized for it, and created
+// again with larger slots when a frame does not fit.
+void openPublisher(FramePublisher *publisher, const std::string &name);
+
+// Copies frame into the next slot, a download straight into shared memory for a
+// cv::UMat. Returns false when the segment cannot be created, then and for
+// every later frame.
+bool publishFrame(FramePublisher *publisher, cv::InputArray frame, int64 grabbed);
+
+// Removes the segment; consumers keep their mapping until they close it.
+void closePublisher(FramePublisher *publisher);
+
+void openFrameBus(FrameBus *bus, const char *name);
+
+// Returns false when either bus failed; the other one keeps publishing.
+bool publishFrames(FrameBus *bus, cv::InputArray captured, cv::InputArray processed, int64 grabbed);
+
+// Prints how far behind every attached consumer is, or that a bus failed,
+// then closes both publishers.
+void closeFrameBus(FrameBus *bus);
+
+// Returns false when no publisher has created name yet or every entry is taken.
+bool openConsumer(FrameConsumer *consumer, const char *name);
+
+// Points *frame at the oldest frame this consumer has not read, in place in
+// shared memory, without waiting. Returns false when there is nothing new. The
+// publisher may overwrite the slot while the frame is being used: check with
+// busFrameIntact afterwards, or copy the frame first and check then.
+bool nextBusFrame(FrameConsumer *consumer, cv::Mat *frame, uint64_t *sequence, int64 *grabbed);
+
+// Whether frame sequence, as nextBusFrame returned it, was not overwritten since.
+bool busFrameIntact(const FrameConsumer *consumer, uint64_t sequence);
+
+void closeConsumer(FrameConsumer *consumer);
+
+// Consumes the bus name (such as ovp.processed) for --bus-read: copies every
+// frame out, checks it was not overwritten meanwhile, and prints the sequence
+// reached and the frames lost once a second, until the publisher has been
+// quiet for BUS_WAIT seconds. Returns the exit status.
+int readFrameBus(const char *name);
+
+#endif //OVP_FRAMEBUS_H
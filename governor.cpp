@@ -0,0 +1,86 @@
+#include <cstdio>
+#include "governor.h"
+
+static const char *degradationNames[DEGRADE_COUNT] = {
+        "full quality", "box blur", "half resolution", "every other frame"
+};
+
+void initGovernor(Governor *governor, double fps) {
+    governor->targetMs = fps > 0 ? 1000 / fps : 0;
+    governor->averageMs = 0;
+    governor->level = DEGRADE_NONE;
+    governor->framesAtLevel = 0;
+    governor->frames = 0;
+}
+
+const char *degradationName(int level) {
+    return level >= 0 && level < DEGRADE_COUNT ? degradationNames[level] : "unknown";
+}
+
+static void changeLevel(Governor *governor, int step) {
+    governor->level += step;
+    printf("governor: %s at %.1f fps, target %.1f\n", degradationName(governor->level), 1000 / governor->averageMs,
+           1000 / governor->targetMs);
+    // the average of the old level says little about the new one
+    governor->averageMs = 0;
+    governor->framesAtLevel = 0;
+}
+
+// Accounts for a frame whose processing began at start.
+static void updateLevel(Governor *governor, int64 start) {
+    double ms = (double) (cv::getTickCount() - start) * 1000 / cv::getTickFrequency();
+    governor->averageMs = governor->averageMs == 0 ? ms : 0.9 * governor->averageMs + 0.1 * ms;
+    if (++governor->framesAtLevel >= GOVERNOR_SETTLE) {
+        if (governor->averageMs > governor->targetMs * GOVERNOR_SLACK && governor->level < DEGRADE_COUNT - 1) {
+            changeLevel(governor, 1);
+        } else if (governor->averageMs < governor->targetMs * GOVERNOR_HEADROOM && governor->level > 0) {
+            changeLevel(governor, -1);
+        }
+    }
+}
+
+template<typename M>
+void applyGoverned(Governor *governor, Algorithms toggles, ProcessingParameters parameters, const M &input, M *frame,
+                   GovernedBuffersOf<M> *buffers, Profiler *profiler) {
+    if (governor->targetMs <= 0) {
+        applyProcessing(toggles, parameters, input, frame, &buffers->buffers, profiler);
+        return;
+    }
+
+    int64 start = cv::getTickCount();
+    int level = governor->level;
+    bool skipping = level >= DEGRADE_SKIP_FRAMES;
+    if (!skipping) buffers->held.release();
+    if (skipping && governor->frames++ % 2 == 1 && !buffers->held.empty()) {
+        *frame = buffers->held;
+        updateLevel(governor, start);
+        return;
+    }
+
+    if (level >= DEGRADE_BOX_BLUR) toggles.boxBlur = true;
+    if (level < DEGRADE_HALF_RESOLUTION) {
+        applyProcessing(toggles, parameters, input, frame, &buffers->buffers, profiler);
+    } else {
+        // kernels sized for the full frame shrink along with it, as with ORDER_APPROXIMATE
+        parameters.gaussianSize = (parameters.gaussianSize / 2) | 1;
+        cv::resize(input, buffers->small, cv::Size(0, 0), 0.5, 0.5, cv::INTER_AREA);
+        M processed;
+        applyProcessing(toggles, parameters, buffers->small, &processed, &buffers->buffers, profiler);
+        // back to the size full resolution gives, which odd sizes would miss by a pixel when doubled
+        cv::Size full = geometrySize(composeGeometry(toggles), input.size());
+        cv::resize(processed, buffers->upscaled, full, 0, 0, cv::INTER_LINEAR);
+        *frame = buffers->upscaled;
+    }
+    // the result may be the input itself, whose buffer the capture thread reuses
+    if (skipping) {
+        frame->copyTo(buffers->held);
+        *frame = buffers->held;
+    }
+    updateLevel(governor, start);
+}
+
+template void applyGoverned<cv::Mat>(Governor *, Algorithms, ProcessingParameters, const cv::Mat &, cv::Mat *,
+                                     GovernedBuffersOf<cv::Mat> *, Profiler *);
+
+template void applyGoverned<cv::UMat>(Governor *, Algorithms, ProcessingParameters, const cv::UMat &, cv::UMat *,
+                                      GovernedBuffersOf<cv::UMat> *, Profiler *);
@@ -0,0 +1,52 @@
+#ifndef OVP_GOVERNOR_H
+#define OVP_GOVERNOR_H
+
+#include <opencv2/opencv.hpp>
+#include "processing.h"
+#include "profiler.h"
+
+#define GOVERNOR_SETTLE 30     // frames at a level before the governor may move again
+#define GOVERNOR_SLACK 1.05    // processing time over the target by this factor degrades one level
+#define GOVERNOR_HEADROOM 0.5  // processing time under the target by this factor restores one level
+
+// How much the governor gives up to hold its frame rate, each level adding to the previous ones.
+typedef enum degradation {
+    DEGRADE_NONE,
+    DEGRADE_BOX_BLUR,        // the box approximation instead of the exact Gaussian
+    DEGRADE_HALF_RESOLUTION, // process a half size frame and scale the result back up
+    DEGRADE_SKIP_FRAMES,     // process every other frame, showing the previous result in between
+    DEGRADE_COUNT
+} Degradation;
+
+typedef struct governor {
+    double targetMs;  // 0 when off
+    double averageMs; // moving average of the time applyGoverned takes per frame
+    int level;        // Degradation
+    int framesAtLevel;
+    long frames;
+} Governor;
+
+// Scratch of applyGoverned, on top of the buffers of applyProcessing.
+template<typename M>
+struct GovernedBuffersOf {
+    FrameBuffersOf<M> buffers;
+    M small;
+    M upscaled;
+    M held; // the result shown again on skipped frames, which may not outlive the input it came from
+};
+
+// Holds fps, or never degrades when it is 0.
+void initGovernor(Governor *governor, double fps);
+
+const char *degradationName(int level);
+
+// Processes input like applyProcessing, degraded as much as the governor
+// decided to. The time the call itself takes, leaving out waiting for the
+// camera and showing the frame, moves the level one step at a time; every
+// change is printed. With cv::UMat it measures when work is queued.
+// Instantiated for cv::Mat and cv::UMat.
+template<typename M>
+void applyGoverned(Governor *governor, Algorithms toggles, ProcessingParameters parameters, const M &input, M *frame,
+                   GovernedBuffersOf<M> *buffers, Profiler *profiler);
+
+#endif //OVP_GOVERNOR_H
@@ -0,0 +1,56 @@
+#include "grabber.h"
+
+static void grabLoop(LatestFrameGrabber *grabber) {
+    while (true) {
+        bool grabbed = grabber->cap->grab();
+        int64 now = cv::getTickCount();
+
+        std::lock_guard<std::mutex> lock(grabber->mutex);
+        if (!grabbed || grabber->stopping) {
+            grabber->ended = true;
+            grabber->ready.notify_all();
+            return;
+        }
+        if (!grabber->wanted) {
+            grabber->skipped++; // the next grab drops it
+            continue;
+        }
+        // the caller is waiting for exactly this frame, so decoding under the lock costs nothing
+        if (!grabber->cap->retrieve(grabber->frame)) continue;
+        grabber->grabbed = now;
+        grabber->wanted = false;
+        grabber->fresh = true;
+        grabber->ready.notify_all();
+    }
+}
+
+void startGrabber(LatestFrameGrabber *grabber, cv::VideoCapture &cap) {
+    grabber->cap = &cap;
+    grabber->wanted = false;
+    grabber->fresh = false;
+    grabber->ended = false;
+    grabber->stopping = false;
+    grabber->grabbed = 0;
+    grabber->skipped = 0;
+    grabber->thread = std::thread(grabLoop, grabber);
+}
+
+bool latestFrame(LatestFrameGrabber *grabber, cv::Mat *frame, int64 *grabbed) {
+    std::unique_lock<std::mutex> lock(grabber->mutex);
+    grabber->wanted = true;
+    grabber->ready.wait(lock, [grabber] { return grabber->fresh || grabber->ended; });
+    if (!grabber->fresh) return false;
+    grabber->fresh = false;
+    std::swap(grabber->frame, *frame);
+    *grabbed = grabber->grabbed;
+    return true;
+}
+
+void stopGrabber(LatestFrameGrabber *grabber) {
+    if (!grabber->thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(grabber->mutex);
+        grabber->stopping = true;
+    }
+    grabber->thread.join(); // after the grab in progress, at most one frame interval
+}
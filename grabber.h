@@ -0,0 +1,36 @@
+#ifndef OVP_GRABBER_H
+#define OVP_GRABBER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <opencv2/opencv.hpp>
+
+// Keeps the capture queue of a camera empty by grabbing on its own thread all
+// the time, and only decodes (retrieves) a frame when someone is waiting for
+// one, so a slow frame loop always gets what the camera sees now instead of
+// what it queued up seconds ago. Every call on cap happens on that thread.
+typedef struct latestFrameGrabber {
+    cv::VideoCapture *cap;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool wanted;   // a caller of latestFrame is waiting
+    bool fresh;    // frame holds a retrieved frame nobody took yet
+    bool ended;
+    bool stopping;
+    cv::Mat frame;
+    int64 grabbed; // tick count when frame was grabbed
+    long skipped;  // frames grabbed while nobody was waiting
+} LatestFrameGrabber;
+
+void startGrabber(LatestFrameGrabber *grabber, cv::VideoCapture &cap);
+
+// Waits for the next frame to be grabbed, at most one frame interval, and
+// swaps it into *frame along with the tick count it was grabbed at. Returns
+// false at the end of the stream.
+bool latestFrame(LatestFrameGrabber *grabber, cv::Mat *frame, int64 *grabbed);
+
+void stopGrabber(LatestFrameGrabber *grabber);
+
+#endif //OVP_GRABBER_H
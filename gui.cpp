@@ -0,0 +1,141 @@
+#include "gui.h"
+
+void spawnTrackbars(ProcessingParameters &parameters) {
+    cv::namedWindow(INPUT_WINDOW);
+    cv::namedWindow(OUTPUT_WINDOW);
+    createTrackbars(OUTPUT_WINDOW, parameters);
+}
+
+void createTrackbars(const std::string &window, ProcessingParameters &parameters) {
+    cv::createTrackbar("Gaussian Blur", window, &parameters.gaussianSize, 100,
+                       assertValidGaussianSize, &parameters.gaussianSize);
+    cv::createTrackbar("Canny High Threshold", window, &parameters.cannyHighThreshold, 255,
+                       assertValidCannyHighThreshold, &parameters.cannyHighThreshold);
+    cv::createTrackbar("Brightness (+255)", window, &parameters.brightness, 510, nullptr, nullptr);
+    cv::createTrackbar("Contrast (x100)", window, &parameters.contrast, 200, nullptr, nullptr);
+}
+
+void showFrames(cv::InputArray original, cv::InputArray processed, Algorithms toggles, Profiler *profiler,
+                cv::Mat *overlay) {
+    int64 start = profileStart(profiler);
+    imshow(INPUT_WINDOW, original);
+    if (toggles.profile && profiler != nullptr) {
+        processed.copyTo(*overlay);
+        drawProfile(profiler, *overlay);
+        imshow(OUTPUT_WINDOW, *overlay);
+    } else {
+        imshow(OUTPUT_WINDOW, processed);
+    }
+    profileEnd(profiler, PROFILE_DISPLAY, start);
+}
+
+void updateToggles(Algorithms *toggles) {
+    applyKey(cv::waitKey(1), toggles);
+}
+
+void applyKey(int key, Algorithms *toggles) {
+    switch (key) {
+        default:
+            break;
+
+        case 27: // stop capturing by pressing ESC
+            toggles->capture = false;
+            break;
+
+        case 49: // 1 - Toggle Gaussian Blur
+            toggles->gaussian = !toggles->gaussian;
+            break;
+
+        case 50: // 2 - Toggle Canny
+            toggles->canny = !toggles->canny;
+            break;
+
+        case 51: // 3 - Toggle Sobel
+            toggles->sobel = !toggles->sobel;
+            break;
+
+        case 52: // 4 - Toggle brightness adjustment
+            toggles->brightness = !toggles->brightness;
+            break;
+
+        case 53: // 5 - Toggle contrast adjustment
+            toggles->contrast = !toggles->contrast;
+            break;
+
+        case 54: // 6 - Toggle negative
+            toggles->negative = !toggles->negative;
+            break;
+
+        case 55: // 7 - Toggle negative
+            toggles->grayscale = !toggles->grayscale;
+            break;
+
+        case 56: // 8 - Toggle resize to half in x
+            toggles->halfSizeX = !toggles->halfSizeX;
+            break;
+
+        case 57: // 9 - Toggle resize to half in y
+            toggles->halfSizeY = !toggles->halfSizeY;
+            break;
+
+        case 65: // A - Rotate 90 degrees
+            toggles->rotationsBy90 = (toggles->rotationsBy90 + 1) % 4;
+            break;
+
+        case 66: // B - Mirror in x
+            toggles->mirrorX = !toggles->mirrorX;
+            break;
+
+        case 67: // C - Mirror in y
+            toggles->mirrorY = !toggles->mirrorY;
+            break;
+
+        case 68: // D - Record
+            toggles->record = !toggles->record;
+            break;
+
+        case 69: // E - Cycle stage ordering tolerance
+            toggles->ordering = (toggles->ordering + 1) % ORDER_COUNT;
+            break;
+
+        case 70: // F - Toggle profiler overlay
+            toggles->profile = !toggles->profile;
+            break;
+
+        case 71: // G - Toggle stripe-parallel processing, one stripe per core
+            toggles->stripes = toggles->stripes > 1 ? 0 : cv::getNumberOfCPUs();
+            break;
+
+        case 72: // H - Toggle box blur approximation of the Gaussian
+            toggles->boxBlur = !toggles->boxBlur;
+            break;
+
+        case 73: // I - Toggle L2 Sobel magnitude
+            toggles->gradientL2 = !toggles->gradientL2;
+            break;
+
+        case 74: // J - Toggle 16-bit Sobel magnitude
+            toggles->wideGradient = !toggles->wideGradient;
+            break;
+
+        case 75: // K - Toggle Canny and Sobel sharing one gradient
+            toggles->sharedGradient = !toggles->sharedGradient;
+            break;
+
+        case 76: // L - Toggle incremental processing of changed tiles
+            toggles->incremental = !toggles->incremental;
+            break;
+    }
+}
+
+void assertValidGaussianSize(int pos, void *size) {
+    auto intSize = (int *) size;
+    if (*intSize % 2 == 0) *intSize = *intSize + 1;
+    if (*intSize < 3) *intSize = 3;
+}
+
+void assertValidCannyHighThreshold(int pos, void *threshold) {
+    auto intTH = (int *) threshold;
+    if (*intTH < 0) *intTH = 0;
+    else if (*intTH > 255) *intTH = 255;
+}
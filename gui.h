@@ -0,0 +1,32 @@
+#ifndef OVP_GUI_H
+#define OVP_GUI_H
+
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "processing.h"
+#include "profiler.h"
+
+#define INPUT_WINDOW "This is you, smile! :)"
+#define OUTPUT_WINDOW "You, but processed!"
+
+void updateToggles(Algorithms *toggles);
+
+// Applies one key code as returned by cv::waitKey.
+void applyKey(int key, Algorithms *toggles);
+
+void assertValidGaussianSize(int pos, void *size);
+
+void assertValidCannyHighThreshold(int pos, void *threshold);
+
+// Creates both windows, and the trackbars on the output one, before any frame exists.
+void spawnTrackbars(ProcessingParameters &parameters);
+
+// Attaches the parameter trackbars to an existing window.
+void createTrackbars(const std::string &window, ProcessingParameters &parameters);
+
+// Shows both windows, timed as PROFILE_DISPLAY. With toggles.profile on, the
+// timings are drawn over a copy of the processed frame kept in *overlay.
+void showFrames(cv::InputArray original, cv::InputArray processed, Algorithms toggles, Profiler *profiler,
+                cv::Mat *overlay);
+
+#endif //OVP_GUI_H
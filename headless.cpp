@@ -0,0 +1,83 @@
+#include <cstdio>
+#include "headless.h"
+#include "recorder.h"
+
+// a header over the mapping on the CPU, a single upload for the OpenCL backend
+static void upload(const cv::Mat &src, cv::Mat *dst) {
+    *dst = src;
+}
+
+static void upload(const cv::Mat &src, cv::UMat *dst) {
+    src.copyTo(*dst);
+}
+
+template<typename M>
+static bool readFrame(cv::VideoCapture &cap, RawReplay *replay, cv::Mat *mapped, M *captured) {
+    if (replay == nullptr) {
+        cap >> *captured;
+        return !captured->empty();
+    }
+    if (!nextRawFrame(replay, mapped)) return false;
+    upload(*mapped, captured);
+    return true;
+}
+
+template<typename M>
+static long processAll(cv::VideoCapture &cap, RawReplay *replay, FrameWriter &writer, const RecorderSettings &output,
+                       double fps, long limit, Algorithms toggles, ProcessingParameters parameters,
+                       Profiler *profiler) {
+    cv::Mat mapped;
+    M captured;
+    M frame;
+    cv::Mat bgr;
+    FrameBuffersOf<M> buffers;
+    long frames = 0;
+    while (limit < 0 || frames < limit) {
+        int64 frameStart = profileStart(profiler);
+        if (!readFrame(cap, replay, &mapped, &captured)) break; // end of video stream
+        profileEnd(profiler, PROFILE_CAPTURE, frameStart);
+
+        applyProcessing(toggles, parameters, captured, &frame, &buffers, profiler);
+
+        if (output.path != nullptr) {
+            // the output size is only known once the first frame went through the chain
+            if (!isWriterOpen(writer) && !openWriter(writer, output, output.path, frame.size(), frame.type(), fps)) {
+                fprintf(stderr, "could not open %s for writing\n", output.path);
+                return -1;
+            }
+            int64 start = profileStart(profiler);
+            recordFrame(writer, frame, &bgr);
+            profileEnd(profiler, PROFILE_RECORD, start);
+        }
+        profileEnd(profiler, PROFILE_FRAME, frameStart);
+        frames++;
+    }
+    return frames;
+}
+
+long processStream(cv::VideoCapture &cap, RawReplay *replay, const RecorderSettings &output, double fps, long limit,
+                   Backend backend, Algorithms toggles, ProcessingParameters parameters, Profiler *profiler) {
+    FrameWriter writer;
+    long frames = backend == BACKEND_OPENCL
+                  ? processAll<cv::UMat>(cap, replay, writer, output, fps, limit, toggles, parameters, profiler)
+                  : processAll<cv::Mat>(cap, replay, writer, output, fps, limit, toggles, parameters, profiler);
+    closeWriter(writer);
+    return frames;
+}
+
+double replayFps(const RecorderSettings &settings, const RawReplay *replay) {
+    if (settings.fps > 0) return settings.fps;
+    return replay->header.fps > 0 ? replay->header.fps : RECORDER_FPS;
+}
+
+int runHeadless(cv::VideoCapture &cap, RawReplay *replay, const RecorderSettings &output, Backend backend,
+                Algorithms toggles, ProcessingParameters parameters, Profiler *profiler) {
+    int64 start = cv::getTickCount();
+    double fps = replay != nullptr ? replayFps(output, replay) : recordingFps(output, cap);
+    long frames = processStream(cap, replay, output, fps, -1, backend, toggles, parameters, profiler);
+    double seconds = (double) (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    if (frames < 0) return 1;
+    printf("%ld frames in %.2f s (%.1f fps)\n", frames, seconds, seconds > 0 ? frames / seconds : 0.0);
+    return 0;
+}
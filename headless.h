@@ -0,0 +1,25 @@
+#ifndef OVP_HEADLESS_H
+#define OVP_HEADLESS_H
+
+#include <opencv2/opencv.hpp>
+#include "processing.h"
+#include "profiler.h"
+#include "rawfile.h"
+#include "recorder.h"
+
+// Processes at most limit frames of replay, or of cap when it is nullptr (all of
+// them when negative), writing them to output.path unless it is nullptr. Returns
+// the number of frames, -1 when the output could not be opened.
+long processStream(cv::VideoCapture &cap, RawReplay *replay, const RecorderSettings &output, double fps, long limit,
+                   Backend backend, Algorithms toggles, ProcessingParameters parameters, Profiler *profiler);
+
+// Frame rate to write replay at: the configured one, or the one it was dumped with.
+double replayFps(const RecorderSettings &settings, const RawReplay *replay);
+
+// Runs the chain over every frame of replay, or of cap when it is nullptr, as
+// fast as possible, without any HighGUI call, writing to output.path unless it
+// is nullptr. Prints the throughput at the end and returns the process exit code.
+int runHeadless(cv::VideoCapture &cap, RawReplay *replay, const RecorderSettings &output, Backend backend,
+                Algorithms toggles, ProcessingParameters parameters, Profiler *profiler);
+
+#endif //OVP_HEADLESS_H
@@ -1,251 +1,221 @@
+#include <cstdio>
+#include <thread>
 #include <opencv2/opencv.hpp>
-
-typedef struct algorithms {
-    bool capture;
-    bool gaussian;
-    bool canny;
-    bool sobel;
-    bool brightness;
-    bool contrast;
-    bool negative;
-    bool grayscale;
-    bool halfSizeX;
-    bool halfSizeY;
-    int rotationsBy90;
-    bool mirrorX;
-    bool mirrorY;
-    bool record;
-} Algorithms;
-
-typedef struct processingParameters {
-    int gaussianSize;
-    int cannyHighThreshold;
-    int brightness;
-    int contrast;
-} ProcessingParameters;
-
-void updateToggles(Algorithms *toggles);
-
-void applyProcessing(Algorithms toggles, ProcessingParameters parameters, cv::Mat *frame);
-
-void assertValidGaussianSize(int pos, void *size);
-
-void assertValidCannyHighThreshold(int pos, void *threshold);
-
-void spawnTrackbars(cv::VideoCapture &cap, ProcessingParameters &parameters);
-
-void openVideoRecorder(cv::VideoCapture &cap, cv::VideoWriter &writer);
+#include "processing.h"
+#include "gui.h"
+#include "recorder.h"
+#include "pipeline.h"
+#include "options.h"
+#include "headless.h"
+#include "batch.h"
+#include "multicam.h"
+#include "capture.h"
+#include "rawfile.h"
+#include "streamer.h"
+#include "framebus.h"
+#include "grabber.h"
+#include "governor.h"
+#include "profiler.h"
+
+template<typename M>
+void runSequential(cv::VideoCapture &cap, NativeCapture *native, LatestFrameGrabber *grabber,
+                   const FrameOutputs &outputs, Governor *governor, Algorithms &toggles,
+                   ProcessingParameters &parameters, Profiler *profiler);
+
+int exportTimings(const Options &options, Profiler *profiler, int status);
+
+// Opens native or replay when they are not nullptr, cap otherwise: the default
+// camera unless --input names another one, a file or a URL.
+static bool openInput(const Options &options, cv::VideoCapture &cap, NativeCapture *native, RawReplay *replay) {
+    if (native != nullptr) return openNative(native, options.input, options.capture);
+    if (replay != nullptr) return openRawReplay(replay, options.input);
+    return openSource(options.input, cap);
+}
 
 int main(int argc, char **argv) {
-    int camera = 0;
-    cv::VideoCapture cap;
-    // open the default camera, use something different from 0 otherwise;
-    // Check VideoCapture documentation.
-    if (!cap.open(camera))
-        return 0;
-
-    // open video recorder
-    cv::VideoWriter writer;
-    openVideoRecorder(cap, writer);
-
+    Options options = defaultOptions();
     Algorithms toggles = {true, false};
     ProcessingParameters parameters = {3, 255, 255, 1};
+    if (!parseOptions(argc, argv, &options, &toggles, &parameters))
+        return 2;
+    if (options.busRead != nullptr) return readFrameBus(options.busRead);
+    StreamSender sender;
+    StreamSender *stream = options.stream != nullptr ? &sender : nullptr;
+    if (stream != nullptr && !parseStreamTarget(options.stream, stream)) return 2;
+
+    // from here on, up to the first frame on screen, is PROFILE_STARTUP
+    static Profiler profiler;
+    initProfiler(&profiler, options.trace != nullptr);
+
+    Backend backend = options.backend;
+    if (!useBackend(backend)) {
+        fprintf(stderr, "OpenCL is not available, processing on the CPU\n");
+        backend = BACKEND_CPU;
+    }
 
-    spawnTrackbars(cap, parameters);
+    if (options.headless && (options.inputs.size() > 1 || options.jobs > 1 || options.segments > 1))
+        return exportTimings(options, &profiler, runBatch(options, backend, toggles, parameters, &profiler));
 
-    while (toggles.capture) {
-        cv::Mat frame;
-        cap >> frame;
-        if (frame.empty()) break; // end of video stream
+    if (!options.headless && options.inputs.size() > 1) {
+        if (backend == BACKEND_OPENCL) fprintf(stderr, "several inputs are processed on the CPU\n");
+        return exportTimings(options, &profiler, runMultiCamera(options, toggles, parameters, &profiler));
+    }
 
-        imshow("This is you, smile! :)", frame);
+    if (options.capture != PIXELS_DEFAULT && options.headless) {
+        fprintf(stderr, "--capture is only used interactively\n");
+        options.capture = PIXELS_DEFAULT;
+    }
+    if (options.capture != PIXELS_DEFAULT && options.latest) {
+        fprintf(stderr, "--latest reads through cv::VideoCapture, ignored with --capture\n");
+        options.latest = false;
+    }
 
-        applyProcessing(toggles, parameters, &frame);
+    if (isRawPath(options.input) && !options.headless) {
+        fprintf(stderr, "raw dumps are replayed with --headless\n");
+        return 1;
+    }
 
-        imshow("You, but processed!", frame);
+    cv::VideoCapture cap;
+    NativeCapture camera;
+    NativeCapture *native = options.capture != PIXELS_DEFAULT ? &camera : nullptr;
+    RawReplay dump;
+    RawReplay *replay = isRawPath(options.input) ? &dump : nullptr;
+    // negotiating with a camera can take a good part of a second, the windows are created meanwhile
+    bool opened = false;
+    std::thread opener([&] { opened = openInput(options, cap, native, replay); });
+    if (!options.headless) spawnTrackbars(parameters);
+    opener.join();
+    if (!opened) {
+        if (native != nullptr || replay != nullptr) return 1; // they said why
+        if (!options.headless) return 0;
+        fprintf(stderr, "could not open %s\n", options.input);
+        return 1;
+    }
 
-        if (toggles.record) {
-            if (frame.channels() == 1) {
-                cv::Mat bgr;
-                cv::cvtColor(frame, bgr, cv::COLOR_GRAY2BGR);
-                frame = bgr;
-            }
-            writer.write(frame);
-        }
+    if (options.headless) {
+        int status = runHeadless(cap, replay, options.recorder, backend, toggles, parameters, &profiler);
+        cap.release();
+        if (replay != nullptr) closeRawReplay(replay);
+        return exportTimings(options, &profiler, status);
+    }
 
-        updateToggles(&toggles);
+    // the recorder opens its file with the size of the first processed frame it gets
+    RecorderSettings settings = options.recorder;
+    if (settings.path == nullptr) settings.path = defaultRecorderSettings().path;
+    if (settings.fps <= 0 && native != nullptr) settings.fps = native->fps;
+    AsyncRecorder recorder;
+    startRecorder(&recorder, settings, recordingFps(settings, cap), options.recordQueue, options.recordOverflow,
+                  &profiler);
+    if (stream != nullptr) startStream(stream, recordingFps(settings, cap), &profiler);
+    FrameBus frameBus;
+    FrameBus *bus = options.bus != nullptr ? &frameBus : nullptr;
+    if (bus != nullptr) openFrameBus(bus, options.bus);
+    FrameOutputs outputs = {&recorder, stream, bus};
+
+    LatestFrameGrabber grabber;
+    LatestFrameGrabber *latest = options.latest ? &grabber : nullptr;
+    if (latest != nullptr) startGrabber(latest, cap);
+    Governor governor;
+    initGovernor(&governor, options.targetFps);
+
+    if (options.pipelined) {
+        runPipelined(cap, native, latest, outputs, &governor, backend, toggles, parameters, &profiler);
+    } else if (backend == BACKEND_OPENCL) {
+        runSequential<cv::UMat>(cap, native, latest, outputs, &governor, toggles, parameters, &profiler);
+    } else {
+        runSequential<cv::Mat>(cap, native, latest, outputs, &governor, toggles, parameters, &profiler);
+    }
+    if (latest != nullptr) {
+        stopGrabber(latest);
+        printf("skipped %ld stale frames\n", latest->skipped);
     }
     cap.release();  // release the VideoCapture object
-    writer.release();  // release the VideoWriter object
-    return 0;
-}
-
-void openVideoRecorder(cv::VideoCapture &cap, cv::VideoWriter &writer) {
-    writer = cv::VideoWriter();
-    cv::Mat firstFrame;
-    cap >> firstFrame;
-    int fourcc = cv::VideoWriter::fourcc('X', 'V', 'I', 'D');
-    writer.open("footage.avi", fourcc, 32.0, cv::Size(640, 480), firstFrame.channels() == 3);
-}
-
-void spawnTrackbars(cv::VideoCapture &cap, ProcessingParameters &parameters) {
-    cv::Mat frame;
-    cap >> frame;
-    imshow("You, but processed!", frame);
-    cv::createTrackbar("Gaussian Blur", "You, but processed!", &parameters.gaussianSize, 100,
-                       assertValidGaussianSize, &parameters.gaussianSize);
-    cv::createTrackbar("Canny High Threshold", "You, but processed!", &parameters.cannyHighThreshold, 255,
-                       assertValidCannyHighThreshold, &parameters.cannyHighThreshold);
-    cv::createTrackbar("Brightness (+255)", "You, but processed!", &parameters.brightness, 510, nullptr, nullptr);
-    cv::createTrackbar("Contrast (x100)", "You, but processed!", &parameters.contrast, 200, nullptr, nullptr);
-}
-
-void updateToggles(Algorithms *toggles) {
-    switch (cv::waitKey(1)) {
-        default:
-            break;
-
-        case 27: // stop capturing by pressing ESC
-            toggles->capture = false;
-            break;
-
-        case 49: // 1 - Toggle Gaussian Blur
-            toggles->gaussian = !toggles->gaussian;
-            break;
-
-        case 50: // 2 - Toggle Canny
-            toggles->canny = !toggles->canny;
-            break;
-
-        case 51: // 3 - Toggle Sobel
-            toggles->sobel = !toggles->sobel;
-            break;
-
-        case 52: // 4 - Toggle brightness adjustment
-            toggles->brightness = !toggles->brightness;
-            break;
-
-        case 53: // 5 - Toggle contrast adjustment
-            toggles->contrast = !toggles->contrast;
-            break;
-
-        case 54: // 6 - Toggle negative
-            toggles->negative = !toggles->negative;
-            break;
-
-        case 55: // 7 - Toggle negative
-            toggles->grayscale = !toggles->grayscale;
-            break;
-
-        case 56: // 8 - Toggle resize to half in x
-            toggles->halfSizeX = !toggles->halfSizeX;
-            break;
-
-        case 57: // 9 - Toggle resize to half in y
-            toggles->halfSizeY = !toggles->halfSizeY;
-            break;
-
-        case 65: // A - Rotate 90 degrees
-            toggles->rotationsBy90 = (toggles->rotationsBy90 + 1) % 4;
-            break;
-
-        case 66: // B - Mirror in x
-            toggles->mirrorX = !toggles->mirrorX;
-            break;
-
-        case 67: // C - Mirror in y
-            toggles->mirrorY = !toggles->mirrorY;
-            break;
-
-        case 68: // D - Record
-            toggles->record = !toggles->record;
-            break;
+    if (native != nullptr) closeNative(native); // unmaps the driver buffers
+    stopRecorder(&recorder);  // flushes and releases the VideoWriter
+    if (droppedFrames(&recorder) > 0) fprintf(stderr, "recorder dropped %ld frames\n", droppedFrames(&recorder));
+    if (stream != nullptr) {
+        stopStream(stream);
+        printf("streamed %ld frames, %ld dropped behind the network, %ld without a connection\n", stream->sent,
+               droppedStreamFrames(stream), stream->failed);
     }
+    if (bus != nullptr) closeFrameBus(bus);
+    ProfileSummary startup = summarizeProfile(&profiler, PROFILE_STARTUP);
+    if (startup.count > 0) printf("first frame shown %.0f ms after startup\n", startup.meanMs);
+    return exportTimings(options, &profiler, 0);
 }
 
-void assertValidGaussianSize(int pos, void *size) {
-    auto intSize = (int *) size;
-    if (*intSize % 2 == 0) *intSize = *intSize + 1;
-    if (*intSize < 3) *intSize = 3;
+// a header over the capture's own memory on the CPU, a single upload for the OpenCL backend
+static void upload(const cv::Mat &src, cv::Mat *dst) {
+    *dst = src;
 }
 
-void assertValidCannyHighThreshold(int pos, void *threshold) {
-    auto intTH = (int *) threshold;
-    if (*intTH < 0) *intTH = 0;
-    else if (*intTH > 255) *intTH = 255;
+static void upload(const cv::Mat &src, cv::UMat *dst) {
+    src.copyTo(*dst);
 }
 
-void applyProcessing(Algorithms toggles, ProcessingParameters parameters, cv::Mat *frame) {
-    if (toggles.gaussian) {
-        cv::Size sizeObj = cv::Size(parameters.gaussianSize, parameters.gaussianSize);
-        cv::GaussianBlur(*frame, *frame, sizeObj, 0, cv::BORDER_DEFAULT);
-    }
-
-    if (toggles.canny) {
-        cv::Mat edges;
-        cv::Canny(*frame, edges, parameters.cannyHighThreshold, (float) parameters.cannyHighThreshold / 3, 3, true);
-        *frame = edges;
+// Reads the next frame into *captured from native, or else from grabber, or
+// from cap when both are nullptr. Only the Y plane is read when the stages
+// toggles enable start with grayscale. Returns false at the end of the stream.
+template<typename M>
+static bool captureFrame(cv::VideoCapture &cap, NativeCapture *native, LatestFrameGrabber *grabber,
+                         const Algorithms &toggles, cv::Mat *host, M *captured, int64 *grabbed) {
+    *grabbed = cv::getTickCount();
+    if (native != nullptr) {
+        // processed and shown before the next call hands the driver buffer back
+        if (!nativeFrame(native, startsWithLuma(toggles), false, host)) return false;
+        upload(*host, captured);
+        return true;
     }
-
-    if (toggles.sobel) {
-        cv::Mat sobelX;
-        cv::Mat sobelY;
-        cv::Sobel(*frame, sobelX, frame->depth(), 1, 0, 3, 1, 0, cv::BORDER_DEFAULT);
-        cv::Sobel(*frame, sobelY, frame->depth(), 0, 1, 3, 1, 0, cv::BORDER_DEFAULT);
-        addWeighted(sobelX, 0.5, sobelY, 0.5, 0, *frame);
+    if (grabber == nullptr) {
+        cap >> *captured;
+        return !captured->empty();
     }
+    // the grabber hands over host frames, and only gets this buffer back at the next call
+    if (!latestFrame(grabber, host, grabbed)) return false;
+    upload(*host, captured);
+    return true;
+}
 
-    if (toggles.brightness) {
-        frame->convertTo(*frame, frame->depth(), 1, parameters.brightness - 255);
-    }
+// M is cv::Mat for the CPU backend and cv::UMat for OpenCL, in which case frames
+// are captured straight into device memory and only downloaded to be shown or recorded.
+template<typename M>
+void runSequential(cv::VideoCapture &cap, NativeCapture *native, LatestFrameGrabber *grabber,
+                   const FrameOutputs &outputs, Governor *governor, Algorithms &toggles,
+                   ProcessingParameters &parameters, Profiler *profiler) {
+    // allocated once and reused by every frame
+    cv::Mat host;
+    M captured;
+    M frame;
+    cv::Mat overlay;
+    GovernedBuffersOf<M> buffers;
+    int64 grabbed;
+    while (toggles.capture) {
+        int64 frameStart = profileStart(profiler);
+        if (!captureFrame(cap, native, grabber, toggles, &host, &captured, &grabbed)) break; // end of video stream
+        profileEnd(profiler, PROFILE_CAPTURE, frameStart);
 
-    if (toggles.contrast) {
-        frame->convertTo(*frame, frame->depth(), (float) (parameters.contrast) / 100, 0);
-    }
+        applyGoverned(governor, toggles, parameters, captured, &frame, &buffers, profiler);
 
-    if (toggles.negative) {
-        frame->convertTo(*frame, frame->depth(), -1, 255);
-    }
+        showFrames(captured, frame, toggles, profiler, &overlay);
+        profileFirstFrame(profiler);
 
-    if (toggles.grayscale) {
-        if (frame->channels() == 3) {
-            cv::Mat gs;
-            cv::cvtColor(*frame, gs, cv::COLOR_BGR2GRAY);
-            *frame = gs;
-        }
-    }
+        deliverFrame(outputs, toggles, captured, frame, grabbed);
 
-    if (toggles.halfSizeX) {
-        cv::Mat halved;
-        cv::resize(*frame, halved, cv::Size(0, 0), 0.5, 1, cv::INTER_LINEAR);
-        *frame = halved;
+        updateToggles(&toggles);
+        profileEnd(profiler, PROFILE_LATENCY, grabbed);
+        profileEnd(profiler, PROFILE_FRAME, frameStart);
     }
+}
 
-    if (toggles.halfSizeY) {
-        cv::Mat halved;
-        cv::resize(*frame, halved, cv::Size(0, 0), 1, 0.5, cv::INTER_LINEAR);
-        *frame = halved;
+// Writes the files asked for with --profile and --trace, failing status if one cannot be written.
+int exportTimings(const Options &options, Profiler *profiler, int status) {
+    if (options.profile != nullptr && !exportProfile(profiler, options.profile)) {
+        fprintf(stderr, "could not write %s\n", options.profile);
+        status = 1;
     }
-
-    for (int rots = 0; rots < toggles.rotationsBy90; rots++) {
-        cv::rotate(*frame, *frame, cv::ROTATE_90_CLOCKWISE);
+    if (options.trace != nullptr && !exportTrace(profiler, options.trace)) {
+        fprintf(stderr, "could not write %s\n", options.trace);
+        status = 1;
     }
-
-    if (toggles.mirrorX && toggles.mirrorY) {
-        cv::Mat flipped;
-        flip(*frame, flipped, -1 /* code for x and y axis */);
-        *frame = flipped;
-    } else {
-        if (toggles.mirrorX) {
-            cv::Mat flipped;
-            flip(*frame, flipped, 0 /* code for x axis */);
-            *frame = flipped;
-        }
-
-        if (toggles.mirrorY) {
-            cv::Mat flipped;
-            flip(*frame, flipped, 1 /* code for x axis */);
-            *frame = flipped;
-        }
-    }
-}
\ No newline at end of file
+    return status;
+}
@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "multicam.h"
+#include "gui.h"
+#include "threadpool.h"
+
+static void scheduleStream(ThreadPool &pool, CameraStream *stream, Profiler *profiler);
+
+static void processOne(ThreadPool &pool, CameraStream *stream, Profiler *profiler) {
+    if (stream->captured.tryPop(stream->working)) {
+        // only one task of a stream is in flight at a time, so it always has a single reader
+        const FrameConfig &current = stream->config.read();
+        applyProcessing(current.toggles, current.parameters, stream->working, &stream->frame, &stream->buffers,
+                        profiler);
+        // frame may alias the stream's buffers, so hand over a copy in the slot's own storage
+        stream->frame.copyTo(stream->result);
+        stream->processed.push(stream->result);
+    }
+
+    // one frame per task, so the workers take turns between the cameras
+    stream->scheduled = false;
+    if (stream->captured.size() > 0) scheduleStream(pool, stream, profiler);
+}
+
+// Queues a task for stream unless one is already queued or running.
+static void scheduleStream(ThreadPool &pool, CameraStream *stream, Profiler *profiler) {
+    if (stream->scheduled.exchange(true)) return;
+    pool.submit([&pool, stream, profiler] { processOne(pool, stream, profiler); });
+}
+
+static void captureLoop(ThreadPool &pool, CameraStream *stream, Profiler *profiler) {
+    cv::Mat frame;
+    while (true) {
+        int64 start = profileStart(profiler);
+        stream->cap >> frame;
+        if (frame.empty()) break; // end of video stream
+        profileEnd(profiler, PROFILE_CAPTURE, start);
+        if (!stream->captured.push(frame)) break;
+        scheduleStream(pool, stream, profiler);
+    }
+    stream->ended = true;
+}
+
+static bool openStream(const Options &options, size_t index, CameraStream *stream, Algorithms toggles,
+                       ProcessingParameters parameters, Profiler *profiler) {
+    const char *input = options.inputs[index];
+    if (!openSource(input, stream->cap)) {
+        fprintf(stderr, "could not open %s\n", input);
+        return false;
+    }
+    stream->index = (int) index;
+    stream->window = std::string(OUTPUT_WINDOW) + " (" + input + ")";
+    stream->toggles = toggles;
+    stream->parameters = parameters;
+    stream->config.publish({toggles, parameters});
+    stream->scheduled = false;
+    stream->ended = false;
+
+    // one file per camera: footage_000.avi, footage_001.avi...
+    RecorderSettings settings = options.recorder;
+    stream->recordPath = numberedPath(settings.path != nullptr ? settings.path : defaultRecorderSettings().path,
+                                      (int) index);
+    settings.path = stream->recordPath.c_str();
+    startRecorder(&stream->recorder, settings, recordingFps(settings, stream->cap), options.recordQueue,
+                  options.recordOverflow, profiler);
+
+    cv::namedWindow(stream->window);
+    createTrackbars(stream->window, stream->parameters);
+    return true;
+}
+
+// Shows and records the latest processed frame of stream, if there is a new one.
+static void presentStream(CameraStream *stream, Profiler *profiler) {
+    if (!stream->processed.tryPop(stream->shown)) return;
+    int64 start = profileStart(profiler);
+    if (stream->toggles.profile && profiler != nullptr) {
+        stream->shown.copyTo(stream->overlay);
+        drawProfile(profiler, stream->overlay);
+        imshow(stream->window, stream->overlay);
+    } else {
+        imshow(stream->window, stream->shown);
+    }
+    profileEnd(profiler, PROFILE_DISPLAY, start);
+    profileFirstFrame(profiler);
+
+    if (stream->toggles.record) submitFrame(&stream->recorder, stream->shown);
+}
+
+static bool streamLive(CameraStream *stream) {
+    return !stream->ended || stream->scheduled || stream->captured.size() > 0 || stream->processed.size() > 0;
+}
+
+int runMultiCamera(const Options &options, Algorithms toggles, ProcessingParameters parameters, Profiler *profiler) {
+    std::vector<std::unique_ptr<CameraStream>> streams;
+    for (size_t i = 0; i < options.inputs.size(); i++) {
+        streams.emplace_back(new CameraStream());
+        if (!openStream(options, i, streams.back().get(), toggles, parameters, profiler)) {
+            for (std::unique_ptr<CameraStream> &stream : streams) stopRecorder(&stream->recorder);
+            return 1;
+        }
+    }
+
+    // the pool is the parallelism now, OpenCV spreading each call over every core would oversubscribe
+    int workers = options.jobs > 0 ? options.jobs : cv::getNumberOfCPUs();
+    cv::setNumThreads(1);
+    {
+        // declared after the streams, so it is drained and joined before they go away
+        ThreadPool pool(workers);
+        for (std::unique_ptr<CameraStream> &stream : streams)
+            stream->captureThread = std::thread(captureLoop, std::ref(pool), stream.get(), profiler);
+
+        size_t active = 0;
+        printf("keys control camera %s, Tab for the next one\n", options.inputs[active]);
+        bool running = true;
+        int64 frameStart = profileStart(profiler);
+        while (running) {
+            bool live = false;
+            for (std::unique_ptr<CameraStream> &stream : streams) {
+                presentStream(stream.get(), profiler);
+                live = live || streamLive(stream.get());
+                stream->config.publish({stream->toggles, stream->parameters});
+            }
+            if (!live) break;
+
+            int key = cv::waitKey(1);
+            if (key == 9) { // Tab - control the next camera
+                active = (active + 1) % streams.size();
+                printf("keys control camera %s\n", options.inputs[active]);
+            } else {
+                applyKey(key, &streams[active]->toggles);
+                running = streams[active]->toggles.capture;
+            }
+
+            // every camera is shown once per iteration
+            profileEnd(profiler, PROFILE_FRAME, frameStart);
+            frameStart = profileStart(profiler);
+        }
+
+        // unblock the capture threads, then let the pool finish what is queued
+        for (std::unique_ptr<CameraStream> &stream : streams) {
+            stream->captured.close();
+            stream->captureThread.join();
+        }
+    }
+
+    for (std::unique_ptr<CameraStream> &stream : streams) {
+        stream->cap.release();
+        stopRecorder(&stream->recorder);
+        long dropped = droppedFrames(&stream->recorder);
+        if (dropped > 0) fprintf(stderr, "recorder of %s dropped %ld frames\n", stream->recordPath.c_str(), dropped);
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef OVP_MULTICAM_H
+#define OVP_MULTICAM_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "options.h"
+#include "pipeline.h"
+#include "processing.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "ringbuffer.h"
+
+#define STREAM_DEPTH 2 // frames queued per camera; older ones are dropped to keep the view live
+
+// One camera with its own chain. Each stream has at most one processing task in
+// flight on the shared pool, so its buffers are never touched concurrently.
+typedef struct cameraStream {
+    int index;
+    std::string window;
+    cv::VideoCapture cap;
+    Algorithms toggles;              // UI thread copies, published through config
+    ProcessingParameters parameters;
+    SharedConfig config{FrameConfig()};
+    RingBuffer<cv::Mat> captured{STREAM_DEPTH, OVERFLOW_DROP_OLDEST};
+    RingBuffer<cv::Mat> processed{STREAM_DEPTH, OVERFLOW_DROP_OLDEST};
+    std::atomic<bool> scheduled;
+    std::atomic<bool> ended;
+    std::thread captureThread;
+    cv::Mat working;                 // owned by the task in flight
+    cv::Mat frame;
+    cv::Mat result;
+    FrameBuffers buffers;
+    cv::Mat shown;                   // owned by the UI thread
+    cv::Mat overlay;
+    std::string recordPath;          // backs recorder.settings.path
+    AsyncRecorder recorder;
+} CameraStream;
+
+// Opens every options.inputs source in one process. Capture runs on one light
+// thread per camera and processing on a work-stealing pool of options.jobs
+// workers (one per core by default) shared by all of them. Tab selects which
+// camera the keys apply to. Processing stays on the CPU. Returns the process
+// exit code.
+int runMultiCamera(const Options &options, Algorithms toggles, ProcessingParameters parameters, Profiler *profiler);
+
+#endif //OVP_MULTICAM_H
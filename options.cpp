@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "options.h"
+#include "gui.h"
+
+static bool isNumber(const char *text) {
+    if (*text == '\0') return false;
+    for (; *text; text++) {
+        if (*text < '0' || *text > '9') return false;
+    }
+    return true;
+}
+
+bool parseToggles(const char *spec, Algorithms *toggles) {
+    std::string names(spec);
+    size_t start = 0;
+    while (start <= names.size()) {
+        size_t end = names.find(',', start);
+        if (end == std::string::npos) end = names.size();
+        std::string name = names.substr(start, end - start);
+        start = end + 1;
+
+        if (name.empty()) continue;
+        else if (name == "gaussian") toggles->gaussian = true;
+        else if (name == "canny") toggles->canny = true;
+        else if (name == "sobel") toggles->sobel = true;
+        else if (name == "boxblur") toggles->boxBlur = true;
+        else if (name == "l2") toggles->gradientL2 = true;
+        else if (name == "sobel16") toggles->wideGradient = true;
+        else if (name == "shared") toggles->sharedGradient = true;
+        else if (name == "incremental") toggles->incremental = true;
+        else if (name == "brightness") toggles->brightness = true;
+        else if (name == "contrast") toggles->contrast = true;
+        else if (name == "negative") toggles->negative = true;
+        else if (name == "grayscale") toggles->grayscale = true;
+        else if (name == "halfx") toggles->halfSizeX = true;
+        else if (name == "halfy") toggles->halfSizeY = true;
+        else if (name == "mirrorx") toggles->mirrorX = true;
+        else if (name == "mirrory") toggles->mirrorY = true;
+        else if (name.compare(0, 8, "stripes=") == 0 && isNumber(name.c_str() + 8))
+            toggles->stripes = atoi(name.c_str() + 8);
+        else if (name.compare(0, 7, "rotate=") == 0 && isNumber(name.c_str() + 7))
+            toggles->rotationsBy90 = atoi(name.c_str() + 7) % 4;
+        else {
+            fprintf(stderr, "unknown toggle '%s'\n", name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+Options defaultOptions() {
+    Options options;
+    options.recorder = defaultRecorderSettings();
+    options.recorder.path = nullptr;
+    return options;
+}
+
+static bool parseEncoder(const char *name, Encoder *encoder) {
+    if (strcmp(name, "default") == 0) *encoder = ENCODER_DEFAULT;
+    else if (strcmp(name, "ffmpeg-hw") == 0) *encoder = ENCODER_FFMPEG_HW;
+    else if (strcmp(name, "x264") == 0) *encoder = ENCODER_X264;
+    else if (strcmp(name, "nvenc") == 0) *encoder = ENCODER_NVENC;
+    else if (strcmp(name, "vaapi") == 0) *encoder = ENCODER_VAAPI;
+    else if (strcmp(name, "qsv") == 0) *encoder = ENCODER_QSV;
+    else return false;
+    return true;
+}
+
+bool parseOptions(int argc, char **argv, Options *options, Algorithms *toggles, ProcessingParameters *parameters) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--pipelined") == 0) options->pipelined = true;
+        else if (strcmp(arg, "--latest") == 0) options->latest = true;
+        else if (strcmp(arg, "--target-fps") == 0 && hasValue) options->targetFps = atof(argv[++i]);
+        else if (strcmp(arg, "--capture") == 0 && hasValue) {
+            const char *format = argv[++i];
+            if (strcmp(format, "default") == 0) options->capture = PIXELS_DEFAULT;
+            else if (strcmp(format, "yuyv") == 0) options->capture = PIXELS_YUYV;
+            else if (strcmp(format, "nv12") == 0) options->capture = PIXELS_NV12;
+            else {
+                fprintf(stderr, "unknown capture format '%s'\n", format);
+                return false;
+            }
+        } else if (strcmp(arg, "--headless") == 0) options->headless = true;
+        else if (strcmp(arg, "--opencl") == 0) options->backend = BACKEND_OPENCL;
+        else if (strcmp(arg, "--input") == 0 && hasValue) {
+            options->input = argv[++i];
+            options->inputs.push_back(options->input);
+        } else if (strcmp(arg, "--jobs") == 0 && hasValue) options->jobs = atoi(argv[++i]);
+        else if (strcmp(arg, "--segments") == 0 && hasValue) options->segments = atoi(argv[++i]);
+        else if (strcmp(arg, "--profile") == 0 && hasValue) options->profile = argv[++i];
+        else if (strcmp(arg, "--trace") == 0 && hasValue) options->trace = argv[++i];
+        else if (strcmp(arg, "--record-queue") == 0 && hasValue) {
+            options->recordQueue = atoi(argv[++i]);
+            if (options->recordQueue < 1) options->recordQueue = 1;
+        } else if (strcmp(arg, "--encoder") == 0 && hasValue) {
+            if (!parseEncoder(argv[++i], &options->recorder.encoder)) {
+                fprintf(stderr, "unknown encoder '%s'\n", argv[i]);
+                return false;
+            }
+        } else if (strcmp(arg, "--fourcc") == 0 && hasValue) {
+            const char *code = argv[++i];
+            if (strlen(code) != 4) {
+                fprintf(stderr, "a fourcc has four characters, not '%s'\n", code);
+                return false;
+            }
+            options->recorder.fourcc = cv::VideoWriter::fourcc(code[0], code[1], code[2], code[3]);
+        } else if (strcmp(arg, "--fps") == 0 && hasValue) options->recorder.fps = atof(argv[++i]);
+        else if (strcmp(arg, "--bitrate") == 0 && hasValue) options->recorder.bitrate = atoi(argv[++i]);
+        else if (strcmp(arg, "--preset") == 0 && hasValue) options->recorder.preset = argv[++i];
+        else if (strcmp(arg, "--record-overflow") == 0 && hasValue) {
+            const char *policy = argv[++i];
+            if (strcmp(policy, "block") == 0) options->recordOverflow = OVERFLOW_BLOCK;
+            else if (strcmp(policy, "drop-oldest") == 0) options->recordOverflow = OVERFLOW_DROP_OLDEST;
+            else if (strcmp(policy, "drop-newest") == 0) options->recordOverflow = OVERFLOW_DROP_NEWEST;
+            else {
+                fprintf(stderr, "unknown overflow policy '%s'\n", policy);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--output") == 0 && hasValue) options->recorder.path = argv[++i];
+        else if (strcmp(arg, "--stream") == 0 && hasValue) options->stream = argv[++i];
+        else if (strcmp(arg, "--bus") == 0 && hasValue) options->bus = argv[++i];
+        else if (strcmp(arg, "--bus-read") == 0 && hasValue) options->busRead = argv[++i];
+        else if (strcmp(arg, "--toggles") == 0 && hasValue) {
+            if (!parseToggles(argv[++i], toggles)) return false;
+        } else if (strcmp(arg, "--ordering") == 0 && hasValue) {
+            int ordering = atoi(argv[++i]);
+            toggles->ordering = ordering >= 0 && ordering < ORDER_COUNT ? ordering : ORDER_AS_WRITTEN;
+        } else if (strcmp(arg, "--gaussian-size") == 0 && hasValue) {
+            parameters->gaussianSize = atoi(argv[++i]);
+            assertValidGaussianSize(parameters->gaussianSize, &parameters->gaussianSize);
+        } else if (strcmp(arg, "--canny-threshold") == 0 && hasValue) {
+            parameters->cannyHighThreshold = atoi(argv[++i]);
+            assertValidCannyHighThreshold(parameters->cannyHighThreshold, &parameters->cannyHighThreshold);
+        } else if (strcmp(arg, "--brightness") == 0 && hasValue) {
+            parameters->brightness = atoi(argv[++i]) + 255; // same offset as the trackbar
+        } else if (strcmp(arg, "--contrast") == 0 && hasValue) {
+            parameters->contrast = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "unknown or incomplete option '%s'\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool openSource(const char *input, cv::VideoCapture &cap) {
+    if (isNumber(input)) return cap.open(atoi(input));
+    return cap.open(input);
+}
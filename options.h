@@ -0,0 +1,46 @@
+#ifndef OVP_OPTIONS_H
+#define OVP_OPTIONS_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "processing.h"
+#include "ringbuffer.h"
+#include "recorder.h"
+#include "capture.h"
+
+// Defaults to a plain interactive session on camera 0; defaultOptions adds the recorder's.
+typedef struct options {
+    bool pipelined = false;
+    bool latest = false;        // grab continuously and only process the newest frame
+    bool headless = false;
+    Backend backend = BACKEND_CPU;
+    const char *input = "0";    // camera index, file or URL
+    int jobs = 0;               // headless worker threads, 0 for one per core
+    int segments = 0;           // pieces a single headless input is split into, 0 for one per job
+    const char *profile = nullptr; // stage timings summary written at exit, CSV or JSON
+    const char *trace = nullptr;   // Chrome trace of every timed section written at exit
+    int recordQueue = RECORDER_QUEUE; // frames the encoder may fall behind by
+    OverflowPolicy recordOverflow = OVERFLOW_DROP_OLDEST;
+    RecorderSettings recorder; // path is the --output, nullptr for the interactive default or no headless output
+    double targetFps = 0; // frame rate the interactive governor holds by degrading quality, 0 for no governor
+    PixelFormat capture = PIXELS_DEFAULT; // V4L2 format the interactive camera is read in, or cv::VideoCapture
+    const char *stream = nullptr;  // tcp:// or rtp:// URL the processed frames are also sent to
+    const char *bus = nullptr;     // shared memory name captured and processed frames are published under
+    const char *busRead = nullptr; // bus segment to consume instead of processing anything
+    std::vector<const char *> inputs; // every --input, in order
+} Options;
+
+Options defaultOptions();
+
+// Parses the command line into options, the initial toggles and the parameters.
+// Prints the problem and returns false on anything it does not understand.
+bool parseOptions(int argc, char **argv, Options *options, Algorithms *toggles, ProcessingParameters *parameters);
+
+// Enables the stages named in a comma separated spec such as
+// "gaussian,canny,halfx,rotate=3".
+bool parseToggles(const char *spec, Algorithms *toggles);
+
+// Opens a camera when input is a number, a file or URL otherwise.
+bool openSource(const char *input, cv::VideoCapture &cap);
+
+#endif //OVP_OPTIONS_H
@@ -0,0 +1,106 @@
+#include <atomic>
+#include <thread>
+#include "pipeline.h"
+#include "ringbuffer.h"
+#include "gui.h"
+#include "recorder.h"
+
+// luma follows the toggles the UI thread last published
+static void captureLoop(cv::VideoCapture &cap, NativeCapture *native, LatestFrameGrabber *grabber,
+                        const std::atomic<bool> &luma, RingBuffer<PipelineFrame> &captured, Profiler *profiler) {
+    PipelineFrame item;
+    while (true) {
+        int64 start = profileStart(profiler);
+        if (native != nullptr) {
+            // queued frames outlive the driver buffer
+            if (!nativeFrame(native, luma.load(std::memory_order_relaxed), true, &item.original)) break;
+            item.grabbed = cv::getTickCount();
+        } else if (grabber != nullptr) {
+            if (!latestFrame(grabber, &item.original, &item.grabbed)) break;
+        } else {
+            cap >> item.original;
+            if (item.original.empty()) break; // end of video stream
+            item.grabbed = cv::getTickCount();
+        }
+        profileEnd(profiler, PROFILE_CAPTURE, start);
+        if (!captured.push(item)) break;
+    }
+    captured.close();
+}
+
+// a header copy on the CPU, a single upload for the OpenCL backend
+static void upload(const cv::Mat &src, cv::Mat *dst) {
+    *dst = src;
+}
+
+static void upload(const cv::Mat &src, cv::UMat *dst) {
+    src.copyTo(*dst);
+}
+
+template<typename M>
+static void processingLoop(SharedConfig &config, Governor *governor, RingBuffer<PipelineFrame> &captured,
+                           RingBuffer<PipelineFrame> &processed, Profiler *profiler) {
+    PipelineFrame item;
+    GovernedBuffersOf<M> buffers;
+    M input;
+    M frame;
+    while (captured.pop(item)) {
+        const FrameConfig &current = config.read();
+
+        // buffers are reused for the next frame, so hand over a copy in the slot's own storage
+        upload(item.original, &input);
+        applyGoverned(governor, current.toggles, current.parameters, input, &frame, &buffers, profiler);
+        frame.copyTo(item.processed);
+
+        if (!processed.push(item)) break;
+    }
+    processed.close();
+}
+
+void deliverFrame(const FrameOutputs &outputs, const Algorithms &toggles, cv::InputArray captured,
+                  cv::InputArray processed, int64 grabbed) {
+    if (toggles.record) submitFrame(outputs.recorder, processed);
+    if (outputs.stream != nullptr) streamFrame(outputs.stream, processed, grabbed);
+    if (outputs.bus != nullptr) publishFrames(outputs.bus, captured, processed, grabbed);
+}
+
+void runPipelined(cv::VideoCapture &cap, NativeCapture *native, LatestFrameGrabber *grabber,
+                  const FrameOutputs &outputs, Governor *governor, Backend backend, Algorithms &toggles,
+                  ProcessingParameters &parameters, Profiler *profiler) {
+    SharedConfig config({toggles, parameters});
+    std::atomic<bool> luma(startsWithLuma(toggles));
+
+    RingBuffer<PipelineFrame> captured(PIPELINE_DEPTH);
+    RingBuffer<PipelineFrame> processed(PIPELINE_DEPTH);
+
+    std::thread captureThread(captureLoop, std::ref(cap), native, grabber, std::cref(luma), std::ref(captured),
+                              profiler);
+    std::thread processingThread(backend == BACKEND_OPENCL ? processingLoop<cv::UMat> : processingLoop<cv::Mat>,
+                                 std::ref(config), governor, std::ref(captured), std::ref(processed), profiler);
+
+    PipelineFrame item;
+    cv::Mat overlay;
+    int64 frameStart = profileStart(profiler);
+    while (toggles.capture && processed.pop(item)) {
+        showFrames(item.original, item.processed, toggles, profiler, &overlay);
+        profileFirstFrame(profiler);
+
+        deliverFrame(outputs, toggles, item.original, item.processed, item.grabbed);
+
+        updateToggles(&toggles);
+        profileEnd(profiler, PROFILE_LATENCY, item.grabbed);
+
+        // the stages overlap, so a frame here is the interval between two displayed frames
+        profileEnd(profiler, PROFILE_FRAME, frameStart);
+        frameStart = profileStart(profiler);
+
+        config.publish({toggles, parameters});
+        luma.store(startsWithLuma(toggles), std::memory_order_relaxed);
+    }
+
+    // unblock both workers whichever side stopped first
+    captured.close();
+    processed.close();
+    captureThread.join();
+    processingThread.join();
+}
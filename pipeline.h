@@ -0,0 +1,54 @@
+#ifndef OVP_PIPELINE_H
+#define OVP_PIPELINE_H
+
+#include <opencv2/opencv.hpp>
+#include "capture.h"
+#include "framebus.h"
+#include "governor.h"
+#include "grabber.h"
+#include "processing.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "streamer.h"
+#include "triplebuffer.h"
+
+#define PIPELINE_DEPTH 3 // frames buffered between two consecutive stages
+
+typedef struct frameConfig {
+    Algorithms toggles;
+    ProcessingParameters parameters;
+} FrameConfig;
+
+// Toggles and parameters are written by the UI thread (keys and trackbars) and
+// read by the processing side once per frame, neither of them ever blocking.
+typedef TripleBuffer<FrameConfig> SharedConfig;
+
+// Everything the shown frames also go to, each on its own terms so none of
+// them holds up the frame loop.
+typedef struct frameOutputs {
+    AsyncRecorder *recorder; // while toggles.record is on
+    StreamSender *stream;    // nullptr unless --stream
+    FrameBus *bus;           // nullptr unless --bus
+} FrameOutputs;
+
+// Hands a frame and the capture it came from to every output that wants it.
+void deliverFrame(const FrameOutputs &outputs, const Algorithms &toggles, cv::InputArray captured,
+                  cv::InputArray processed, int64 grabbed);
+
+typedef struct pipelineFrame {
+    cv::Mat original;
+    cv::Mat processed;
+    int64 grabbed; // tick count at capture, for PROFILE_LATENCY
+} PipelineFrame;
+
+// Runs capture, processing and display on three threads joined by bounded ring
+// buffers, so each stage overlaps with the others, and delivers them to outputs
+// from the display thread. HighGUI stays on the calling thread, which must be
+// the main one. Frames come from native, or else grabber, instead of straight
+// from cap unless they are nullptr, and are processed at the quality governor
+// allows.
+void runPipelined(cv::VideoCapture &cap, NativeCapture *native, LatestFrameGrabber *grabber,
+                  const FrameOutputs &outputs, Governor *governor, Backend backend, Algorithms &toggles,
+                  ProcessingParameters &parameters, Profiler *profiler);
+
+#endif //OVP_PIPELINE_H
@@ -0,0 +1,842 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include "processing.h"
+#include "profiler.h"
+
+void collectPointOperations(Algorithms toggles, ProcessingParameters parameters, PointChain *chain) {
+    chain->length = 0;
+    if (toggles.brightness) {
+        chain->operations[chain->length++] = {1, (double) (parameters.brightness - 255)};
+    }
+    if (toggles.contrast) {
+        chain->operations[chain->length++] = {(float) (parameters.contrast) / 100, 0};
+    }
+    if (toggles.negative) {
+        chain->operations[chain->length++] = {-1, 255};
+    }
+}
+
+bool useBackend(Backend backend) {
+    if (backend == BACKEND_OPENCL) {
+        if (!cv::ocl::haveOpenCL()) return false;
+        cv::ocl::setUseOpenCL(true);
+        return cv::ocl::useOpenCL();
+    }
+    return true;
+}
+
+Geometry composeGeometry(Algorithms toggles) {
+    Geometry geometry = {toggles.halfSizeX, toggles.halfSizeY, false, false, false};
+
+    // a clockwise rotation is a transpose followed by a column flip; transposing
+    // after the flips accumulated so far swaps which axis they act on
+    for (int rots = 0; rots < toggles.rotationsBy90; rots++) {
+        geometry.transpose = !geometry.transpose;
+        std::swap(geometry.flipRows, geometry.flipCols);
+        geometry.flipCols = !geometry.flipCols;
+    }
+
+    if (toggles.mirrorX) geometry.flipRows = !geometry.flipRows; // flip around the x axis
+    if (toggles.mirrorY) geometry.flipCols = !geometry.flipCols; // flip around the y axis
+    return geometry;
+}
+
+bool isIdentityGeometry(const Geometry &geometry) {
+    return !geometry.halfSizeX && !geometry.halfSizeY && !geometry.transpose && !geometry.flipRows &&
+           !geometry.flipCols;
+}
+
+cv::Size geometrySize(const Geometry &geometry, cv::Size source) {
+    // same rounding as cv::resize with a 0.5 factor
+    cv::Size halved(geometry.halfSizeX ? cv::saturate_cast<int>(source.width * 0.5) : source.width,
+                    geometry.halfSizeY ? cv::saturate_cast<int>(source.height * 0.5) : source.height);
+    return geometry.transpose ? cv::Size(halved.height, halved.width) : halved;
+}
+
+static bool sameGeometry(const Geometry &a, const Geometry &b) {
+    return a.halfSizeX == b.halfSizeX && a.halfSizeY == b.halfSizeY && a.transpose == b.transpose &&
+           a.flipRows == b.flipRows && a.flipCols == b.flipCols;
+}
+
+template<typename M>
+static void buildGeometryMaps(const Geometry &geometry, cv::Size source, GeometryMapsOf<M> *maps) {
+    cv::Size target = geometrySize(geometry, source);
+
+    // walk every step backwards from the target pixel to its source position
+    cv::Mat map(target, CV_32FC2);
+    for (int y = 0; y < target.height; y++) {
+        auto row = map.ptr<cv::Point2f>(y);
+        for (int x = 0; x < target.width; x++) {
+            int cx = geometry.flipCols ? target.width - 1 - x : x;
+            int cy = geometry.flipRows ? target.height - 1 - y : y;
+            if (geometry.transpose) std::swap(cx, cy);
+            // a linear 2:1 resize samples halfway between each pair of source pixels
+            row[x] = cv::Point2f(geometry.halfSizeX ? 2 * cx + 0.5f : (float) cx,
+                                 geometry.halfSizeY ? 2 * cy + 0.5f : (float) cy);
+        }
+    }
+
+    bool nearest = !geometry.halfSizeX && !geometry.halfSizeY;
+    cv::convertMaps(map, cv::noArray(), maps->xy, maps->weights, CV_16SC2, nearest);
+    maps->geometry = geometry;
+    maps->source = source;
+}
+
+template<typename M>
+void applyGeometry(const Geometry &geometry, const M &src, M *dst, GeometryMapsOf<M> *maps) {
+    bool halving = geometry.halfSizeX || geometry.halfSizeY;
+    bool flipping = geometry.flipRows || geometry.flipCols;
+
+    if (!geometry.transpose && !flipping) {
+        cv::resize(src, *dst, cv::Size(0, 0), geometry.halfSizeX ? 0.5 : 1, geometry.halfSizeY ? 0.5 : 1,
+                   cv::INTER_LINEAR);
+        return;
+    }
+
+    if (!geometry.transpose && !halving) {
+        int code = geometry.flipRows && geometry.flipCols ? -1 : geometry.flipRows ? 0 : 1;
+        cv::flip(src, *dst, code);
+        return;
+    }
+
+    if (maps->xy.empty() || maps->source != src.size() || !sameGeometry(maps->geometry, geometry)) {
+        buildGeometryMaps(geometry, src.size(), maps);
+    }
+    cv::remap(src, *dst, maps->xy, maps->weights, halving ? cv::INTER_LINEAR : cv::INTER_NEAREST,
+              cv::BORDER_REPLICATE);
+}
+
+void boxBlurWidths(int size, int widths[BOX_PASSES]) {
+    // a box of width w has variance (w^2 - 1) / 12, and variances add up;
+    // mixing two odd widths matches the Gaussian variance as closely as possible
+    double sigma = 0.3 * ((size - 1) * 0.5 - 1) + 0.8;
+    double variance = 12 * sigma * sigma;
+    int lower = (int) std::floor(std::sqrt(variance / BOX_PASSES + 1));
+    if (lower % 2 == 0) lower--;
+    if (lower < 1) lower = 1;
+    int upper = lower + 2;
+    int lowerPasses = (int) std::lround((variance - BOX_PASSES * lower * lower - 4 * BOX_PASSES * lower -
+                                         3 * BOX_PASSES) / (-4.0 * lower - 4));
+    for (int i = 0; i < BOX_PASSES; i++) widths[i] = i < lowerPasses ? lower : upper;
+}
+
+template<typename M>
+void applyBoxBlur(const M &src, M *dst, M *scratch, cv::Size size) {
+    int widthsX[BOX_PASSES];
+    int widthsY[BOX_PASSES];
+    boxBlurWidths(size.width, widthsX);
+    boxBlurWidths(size.height, widthsY);
+
+    // the last pass has to land in *dst
+    M *targets[2] = {BOX_PASSES % 2 == 1 ? dst : scratch, BOX_PASSES % 2 == 1 ? scratch : dst};
+    const M *from = &src;
+    for (int i = 0; i < BOX_PASSES; i++) {
+        cv::boxFilter(*from, *targets[i % 2], -1, cv::Size(widthsX[i], widthsY[i]), cv::Point(-1, -1), true,
+                      cv::BORDER_DEFAULT);
+        from = targets[i % 2];
+    }
+}
+
+// Magnitude of one pixel, in the range of T.
+template<typename T>
+static inline T gradientMagnitude(int dx, int dy, bool l2) {
+    if (sizeof(T) == 1) {
+        return l2 ? cv::saturate_cast<T>(std::sqrt((float) (dx * dx + dy * dy)))
+                  : cv::saturate_cast<T>((std::abs(dx) + std::abs(dy) + 1) >> 1);
+    }
+    return cv::saturate_cast<T>(l2 ? std::sqrt((float) (dx * dx + dy * dy)) * GRADIENT_WIDE_SCALE
+                                   : (std::abs(dx) + std::abs(dy)) * GRADIENT_WIDE_SCALE);
+}
+
+// Rows of the fused gradient, reflecting the edges like BORDER_REFLECT_101.
+template<typename T>
+static void fusedGradientRows(const cv::Mat &src, bool l2, cv::Mat *magnitude, cv::Mat *dx, cv::Mat *dy,
+                              const cv::Range &rows) {
+    int cn = src.channels();
+    int width = src.cols * cn;
+    int last = src.rows - 1;
+    for (int y = rows.start; y < rows.end; y++) {
+        const uchar *up = src.ptr<uchar>(y > 0 ? y - 1 : std::min(1, last));
+        const uchar *mid = src.ptr<uchar>(y);
+        const uchar *down = src.ptr<uchar>(y < last ? y + 1 : std::max(last - 1, 0));
+        T *out = magnitude->ptr<T>(y);
+        short *outX = dx != nullptr ? dx->ptr<short>(y) : nullptr;
+        short *outY = dy != nullptr ? dy->ptr<short>(y) : nullptr;
+
+        auto pixel = [&](int i, int left, int right) {
+            int gx = up[right] + 2 * mid[right] + down[right] - up[left] - 2 * mid[left] - down[left];
+            int gy = down[left] + 2 * down[i] + down[right] - up[left] - 2 * up[i] - up[right];
+            out[i] = gradientMagnitude<T>(gx, gy, l2);
+            if (outX != nullptr) outX[i] = (short) gx;
+            if (outY != nullptr) outY[i] = (short) gy;
+        };
+
+        // a single column reflects onto itself
+        int border = src.cols > 1 ? cn : 0;
+        for (int i = 0; i < std::min(cn, width); i++) pixel(i, i + border, i + border);
+        for (int i = cn; i < width - cn; i++) pixel(i, i - cn, i + cn);
+        for (int i = std::max(cn, width - cn); i < width; i++) pixel(i, i - border, i - border);
+    }
+}
+
+static bool applyFusedGradient(const cv::Mat &src, bool l2, bool wide, bool derivatives, cv::Mat *magnitude,
+                               GradientBuffersOf<cv::Mat> *gradient) {
+    if (src.depth() != CV_8U) return false;
+    magnitude->create(src.size(), CV_MAKETYPE(wide ? CV_16U : CV_8U, src.channels()));
+    cv::Mat *dx = derivatives ? &gradient->dx : nullptr;
+    cv::Mat *dy = derivatives ? &gradient->dy : nullptr;
+    if (derivatives) {
+        dx->create(src.size(), CV_MAKETYPE(CV_16S, src.channels()));
+        dy->create(src.size(), CV_MAKETYPE(CV_16S, src.channels()));
+    }
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &rows) {
+        if (wide) fusedGradientRows<ushort>(src, l2, magnitude, dx, dy, rows);
+        else fusedGradientRows<uchar>(src, l2, magnitude, dx, dy, rows);
+    });
+    return true;
+}
+
+static bool applyFusedGradient(const cv::UMat &, bool, bool, bool, cv::UMat *, GradientBuffersOf<cv::UMat> *) {
+    return false;
+}
+
+template<typename M>
+void applyGradient(const M &src, bool l2, bool wide, bool derivatives, M *magnitude, GradientBuffersOf<M> *gradient) {
+    if (applyFusedGradient(src, l2, wide, derivatives, magnitude, gradient)) return;
+
+    // same results in a few passes: both derivatives, then the magnitude
+    int depth = src.depth() == CV_8U ? CV_16S : CV_32F;
+    cv::Sobel(src, gradient->dx, depth, 1, 0, 3, 1, 0, cv::BORDER_DEFAULT);
+    cv::Sobel(src, gradient->dy, depth, 0, 1, 3, 1, 0, cv::BORDER_DEFAULT);
+    gradient->dx.convertTo(gradient->floatX, CV_32F);
+    gradient->dy.convertTo(gradient->floatY, CV_32F);
+    if (l2) {
+        cv::magnitude(gradient->floatX.reshape(1), gradient->floatY.reshape(1), gradient->sum);
+        gradient->sum = gradient->sum.reshape(src.channels());
+    } else {
+        cv::absdiff(gradient->floatX, cv::Scalar::all(0), gradient->floatX);
+        cv::absdiff(gradient->floatY, cv::Scalar::all(0), gradient->floatY);
+        cv::add(gradient->floatX, gradient->floatY, gradient->sum);
+    }
+    double scale = wide ? GRADIENT_WIDE_SCALE : l2 ? 1 : 0.5;
+    // convertTo rounds halves to even; a quarter up makes the integer sums round
+    // halves up, like (|dx| + |dy| + 1) >> 1 in the fused kernel
+    double shift = !wide && !l2 && src.depth() == CV_8U ? 0.25 : 0;
+    gradient->sum.convertTo(*magnitude, wide ? CV_16U : src.depth(), scale, shift);
+}
+
+void buildPointLut(const PointChain &chain, cv::Mat *lut) {
+    lut->create(1, 256, CV_8U);
+    auto table = lut->ptr<uchar>();
+    for (int value = 0; value < 256; value++) {
+        uchar mapped = (uchar) value;
+        for (int i = 0; i < chain.length; i++) {
+            // convertTo evaluates 8-bit maps in single precision
+            mapped = cv::saturate_cast<uchar>((float) chain.operations[i].alpha * mapped +
+                                              (float) chain.operations[i].beta);
+        }
+        table[value] = mapped;
+    }
+}
+
+template<typename M>
+void applyPointChain(const PointChain &chain, const M &lut, const M &src, M *dst) {
+    if (src.depth() == CV_8U) {
+        cv::LUT(src, lut, *dst);
+        return;
+    }
+
+    double alpha = 1;
+    double beta = 0;
+    for (int i = 0; i < chain.length; i++) {
+        alpha = chain.operations[i].alpha * alpha;
+        beta = chain.operations[i].alpha * beta + chain.operations[i].beta;
+    }
+    src.convertTo(*dst, src.depth(), alpha, beta);
+}
+
+void orderStages(Algorithms toggles, StageList *list) {
+    list->length = 0;
+    list->geometry = composeGeometry(toggles);
+
+    bool halving = toggles.halfSizeX || toggles.halfSizeY;
+    bool orienting = list->geometry.transpose || list->geometry.flipRows || list->geometry.flipCols;
+    bool pointOperations = toggles.brightness || toggles.contrast || toggles.negative;
+    bool grayscale = toggles.grayscale;
+    bool splitHalving = false;
+    bool edges = toggles.canny && toggles.sobel && toggles.sharedGradient;
+    // colour never reaches the output: the edge map has one channel, and so has all that follows it
+    bool lumaOutput = grayscale || (toggles.canny && !edges);
+
+    if (toggles.ordering == ORDER_APPROXIMATE) {
+        splitHalving = halving;
+        if (halving) list->stages[list->length++] = STAGE_HALVE;
+        // the whole chain then reads a third of the data, and a luma capture is not converted at all
+        if (lumaOutput) list->stages[list->length++] = STAGE_GRAYSCALE;
+        grayscale = false;
+    } else if (toggles.ordering == ORDER_EXACT) {
+        if (toggles.canny && !edges) {
+            grayscale = false; // the edge map is single channel already
+        } else if (grayscale && !toggles.sobel && !pointOperations) {
+            // both are linear, so only rounding differs
+            list->stages[list->length++] = STAGE_GRAYSCALE;
+            grayscale = false;
+        }
+    }
+
+    if (toggles.gaussian) list->stages[list->length++] = STAGE_GAUSSIAN;
+    if (edges) {
+        list->stages[list->length++] = STAGE_EDGES;
+    } else {
+        if (toggles.canny) list->stages[list->length++] = STAGE_CANNY;
+        if (toggles.sobel) list->stages[list->length++] = STAGE_SOBEL;
+    }
+    if (pointOperations) list->stages[list->length++] = STAGE_POINT;
+
+    // halving commutes with grayscale up to rounding, but is only split from the
+    // geometry when that does not cost an extra pass
+    if (toggles.ordering == ORDER_EXACT && grayscale && halving && !orienting) {
+        splitHalving = true;
+        list->stages[list->length++] = STAGE_HALVE;
+    }
+    if (grayscale) list->stages[list->length++] = STAGE_GRAYSCALE;
+
+    if (splitHalving) {
+        list->geometry.halfSizeX = false;
+        list->geometry.halfSizeY = false;
+    }
+    if (!isIdentityGeometry(list->geometry)) list->stages[list->length++] = STAGE_GEOMETRY;
+}
+
+bool startsWithLuma(Algorithms toggles) {
+    StageList list;
+    orderStages(toggles, &list);
+    for (int i = 0; i < list.length; i++) {
+        if (list.stages[i] == STAGE_GRAYSCALE) return true;
+        if (list.stages[i] != STAGE_HALVE) return false;
+    }
+    return false;
+}
+
+static bool sameToggles(const Algorithms &a, const Algorithms &b) {
+    // capture, record and profile do not change the processing
+    return a.gaussian == b.gaussian && a.canny == b.canny && a.sobel == b.sobel && a.brightness == b.brightness &&
+           a.contrast == b.contrast && a.negative == b.negative && a.grayscale == b.grayscale &&
+           a.halfSizeX == b.halfSizeX && a.halfSizeY == b.halfSizeY && a.rotationsBy90 == b.rotationsBy90 &&
+           a.mirrorX == b.mirrorX && a.mirrorY == b.mirrorY && a.ordering == b.ordering && a.stripes == b.stripes &&
+           a.boxBlur == b.boxBlur && a.gradientL2 == b.gradientL2 && a.wideGradient == b.wideGradient &&
+           a.sharedGradient == b.sharedGradient && a.incremental == b.incremental;
+}
+
+static bool sameParameters(const ProcessingParameters &a, const ProcessingParameters &b) {
+    return a.gaussianSize == b.gaussianSize && a.cannyHighThreshold == b.cannyHighThreshold &&
+           a.brightness == b.brightness && a.contrast == b.contrast;
+}
+
+bool planMatches(const ProcessingPlan &plan, Algorithms toggles, ProcessingParameters parameters) {
+    return plan.compiled && sameToggles(plan.toggles, toggles) && sameParameters(plan.parameters, parameters);
+}
+
+// Rows each side of a stripe the stage reads from.
+static int stageHalo(Stage stage, cv::Size kernel, bool boxBlur) {
+    switch (stage) {
+        case STAGE_GAUSSIAN: {
+            if (!boxBlur) return kernel.height / 2;
+            int widths[BOX_PASSES];
+            boxBlurWidths(kernel.height, widths);
+            int halo = 0;
+            for (int width : widths) halo += width / 2;
+            return halo;
+        }
+        case STAGE_CANNY:
+        case STAGE_EDGES:
+            return CANNY_HALO;
+        case STAGE_SOBEL:
+            return 1;
+        default:
+            return 0; // point operations and grayscale only read their own pixel
+    }
+}
+
+static int findFixedPipeline(const ProcessingPlan &plan);
+
+void compilePlan(Algorithms toggles, ProcessingParameters parameters, ProcessingPlan *plan) {
+    plan->compiled = true;
+    plan->generation++;
+    plan->toggles = toggles;
+    plan->parameters = parameters;
+
+    StageList list;
+    orderStages(toggles, &list);
+    plan->geometry = list.geometry;
+    plan->halving = {toggles.halfSizeX, toggles.halfSizeY, false, false, false};
+    plan->cannyHigh = parameters.cannyHighThreshold;
+    plan->cannyLow = (float) parameters.cannyHighThreshold / 3;
+
+    collectPointOperations(toggles, parameters, &plan->chain);
+    if (plan->chain.length > 0) buildPointLut(plan->chain, &plan->pointLut);
+
+    // kernels sized for the full frame shrink along with it once STAGE_HALVE ran
+    bool halvedX = false;
+    bool halvedY = false;
+    plan->length = list.length;
+    for (int i = 0; i < list.length; i++) {
+        PlannedStage *stage = &plan->stages[i];
+        stage->stage = list.stages[i];
+        int size = parameters.gaussianSize;
+        stage->kernel = cv::Size(halvedX ? (size / 2) | 1 : size, halvedY ? (size / 2) | 1 : size);
+        stage->halo = stageHalo(stage->stage, stage->kernel, toggles.boxBlur);
+        if (stage->stage == STAGE_HALVE) {
+            halvedX = toggles.halfSizeX;
+            halvedY = toggles.halfSizeY;
+        }
+    }
+    plan->fixed = findFixedPipeline(*plan);
+}
+
+// The plan's point table, copied next to the frames the first time a plan uses it.
+template<typename M>
+static const M &pointLutOf(const ProcessingPlan &plan, StageBuffersOf<M> *buffers) {
+    if (buffers->lutGeneration != plan.generation) {
+        plan.pointLut.copyTo(buffers->pointLut);
+        buffers->lutGeneration = plan.generation;
+    }
+    return buffers->pointLut;
+}
+
+// Tags one stage, for the overloads of applyKernel below, so fixed pipelines
+// pick a stage's kernel at compile time and the generic loop with a switch.
+template<Stage S>
+struct StageKernel {};
+
+template<typename M>
+static void applyKernel(StageKernel<STAGE_GAUSSIAN>, const ProcessingPlan &plan, const PlannedStage &stage, M *frame,
+                        StageBuffersOf<M> *buffers) {
+    if (plan.toggles.boxBlur) applyBoxBlur(*frame, &buffers->blurred, &buffers->boxed, stage.kernel);
+    else cv::GaussianBlur(*frame, buffers->blurred, stage.kernel, 0, cv::BORDER_DEFAULT);
+    *frame = buffers->blurred;
+}
+
+template<typename M>
+static void applyKernel(StageKernel<STAGE_CANNY>, const ProcessingPlan &plan, const PlannedStage &, M *frame,
+                        StageBuffersOf<M> *buffers) {
+    cv::Canny(*frame, buffers->edges, plan.cannyHigh, plan.cannyLow, 3, true);
+    *frame = buffers->edges;
+}
+
+template<typename M>
+static void applyKernel(StageKernel<STAGE_SOBEL>, const ProcessingPlan &plan, const PlannedStage &, M *frame,
+                        StageBuffersOf<M> *buffers) {
+    applyGradient(*frame, plan.toggles.gradientL2, plan.toggles.wideGradient, false, &buffers->sobel,
+                  &buffers->gradient);
+    *frame = buffers->sobel;
+}
+
+template<typename M>
+static void applyKernel(StageKernel<STAGE_POINT>, const ProcessingPlan &plan, const PlannedStage &, M *frame,
+                        StageBuffersOf<M> *buffers) {
+    applyPointChain(plan.chain, pointLutOf(plan, buffers), *frame, &buffers->adjusted);
+    *frame = buffers->adjusted;
+}
+
+template<typename M>
+static void applyKernel(StageKernel<STAGE_GRAYSCALE>, const ProcessingPlan &, const PlannedStage &, M *frame,
+                        StageBuffersOf<M> *buffers) {
+    if (frame->channels() == 3) {
+        cv::cvtColor(*frame, buffers->gray, cv::COLOR_BGR2GRAY);
+        *frame = buffers->gray;
+    }
+}
+
+template<typename M>
+static void applyKernel(StageKernel<STAGE_HALVE>, const ProcessingPlan &plan, const PlannedStage &, M *frame,
+                        StageBuffersOf<M> *buffers) {
+    applyGeometry(plan.halving, *frame, &buffers->halved, &buffers->geometryMaps);
+    *frame = buffers->halved;
+}
+
+template<typename M>
+static void applyKernel(StageKernel<STAGE_GEOMETRY>, const ProcessingPlan &plan, const PlannedStage &, M *frame,
+                        StageBuffersOf<M> *buffers) {
+    applyGeometry(plan.geometry, *frame, &buffers->transformed, &buffers->geometryMaps);
+    *frame = buffers->transformed;
+}
+
+// Canny runs its hysteresis on the derivatives of the Sobel stage, which it
+// would otherwise compute again, and the edges are drawn over Sobel's magnitude.
+template<typename M>
+static void applyKernel(StageKernel<STAGE_EDGES>, const ProcessingPlan &plan, const PlannedStage &, M *frame,
+                        StageBuffersOf<M> *buffers) {
+    const Algorithms &toggles = plan.toggles;
+    GradientBuffersOf<M> *gradient = &buffers->gradient;
+    applyGradient(*frame, toggles.gradientL2, toggles.wideGradient, true, &buffers->sobel, gradient);
+    if (gradient->dx.depth() != CV_16S) {
+        gradient->dx.convertTo(gradient->dx, CV_16S);
+        gradient->dy.convertTo(gradient->dy, CV_16S);
+    }
+    cv::Canny(gradient->dx, gradient->dy, buffers->edges, plan.cannyHigh, plan.cannyLow, true);
+    buffers->sobel.setTo(cv::Scalar::all(toggles.wideGradient ? 65535 : 255), buffers->edges);
+    *frame = buffers->sobel;
+}
+
+// Applies one stage of plan to *frame.
+template<typename M>
+static void applyStage(const ProcessingPlan &plan, const PlannedStage &stage, M *frame, StageBuffersOf<M> *buffers) {
+    switch (stage.stage) {
+        case STAGE_GAUSSIAN:
+            applyKernel(StageKernel<STAGE_GAUSSIAN>(), plan, stage, frame, buffers);
+            break;
+
+        case STAGE_CANNY:
+            applyKernel(StageKernel<STAGE_CANNY>(), plan, stage, frame, buffers);
+            break;
+
+        case STAGE_SOBEL:
+            applyKernel(StageKernel<STAGE_SOBEL>(), plan, stage, frame, buffers);
+            break;
+
+        case STAGE_POINT:
+            applyKernel(StageKernel<STAGE_POINT>(), plan, stage, frame, buffers);
+            break;
+
+        case STAGE_GRAYSCALE:
+            applyKernel(StageKernel<STAGE_GRAYSCALE>(), plan, stage, frame, buffers);
+            break;
+
+        case STAGE_HALVE:
+            applyKernel(StageKernel<STAGE_HALVE>(), plan, stage, frame, buffers);
+            break;
+
+        case STAGE_GEOMETRY:
+            applyKernel(StageKernel<STAGE_GEOMETRY>(), plan, stage, frame, buffers);
+            break;
+
+        case STAGE_EDGES:
+            applyKernel(StageKernel<STAGE_EDGES>(), plan, stage, frame, buffers);
+            break;
+    }
+}
+
+// Stages whose output rows only depend on nearby input rows, which can run on stripes.
+static bool isLocalStage(Stage stage) {
+    return stage != STAGE_HALVE && stage != STAGE_GEOMETRY;
+}
+
+// Type stages[first, last) turn a frame of the given type into.
+static int stripedType(const ProcessingPlan &plan, int first, int last, int type) {
+    for (int i = first; i < last; i++) {
+        Stage stage = plan.stages[i].stage;
+        if (stage == STAGE_CANNY) type = CV_8UC1;
+        else if ((stage == STAGE_SOBEL || stage == STAGE_EDGES) && plan.toggles.wideGradient)
+            type = CV_MAKETYPE(CV_16U, CV_MAT_CN(type));
+        else if (stage == STAGE_GRAYSCALE && CV_MAT_CN(type) == 3) type = CV_MAKETYPE(CV_MAT_DEPTH(type), 1);
+    }
+    return type;
+}
+
+// Runs stages[first, last) on toggles.stripes horizontal stripes of *frame in
+// parallel. Each stripe is processed with halo rows above and below it, enough
+// for every stage to read the same rows as on the whole frame, which are dropped
+// when it is copied into the striped result. Returns false, leaving the stages
+// to the caller, when the frame is too short to split.
+static bool applyStriped(const ProcessingPlan &plan, int first, int last, cv::Mat *frame, FrameBuffers *buffers,
+                         Profiler *profiler) {
+    int halo = 0;
+    for (int i = first; i < last; i++) halo += plan.stages[i].halo;
+    int rows = frame->rows;
+    int count = std::min(plan.toggles.stripes, rows / std::max(STRIPE_MIN_ROWS, halo));
+    if (count < 2) return false;
+
+    if ((int) buffers->stripes.size() < count) buffers->stripes.resize(count);
+    buffers->striped.create(frame->size(), stripedType(plan, first, last, frame->type()));
+    cv::Mat source = *frame;
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range) {
+        for (int s = range.start; s < range.end; s++) {
+            int top = rows * s / count;
+            int bottom = rows * (s + 1) / count;
+            int from = std::max(0, top - halo);
+            int to = std::min(rows, bottom + halo);
+
+            // the first stage reads the real rows around the stripe, the following ones its own halo
+            cv::Mat stripe = source.rowRange(from, to);
+            Profiler *timed = s == 0 ? profiler : nullptr;
+            for (int i = first; i < last; i++) {
+                int64 start = profileStart(timed);
+                applyStage(plan, plan.stages[i], &stripe, &buffers->stripes[s]);
+                profileEnd(timed, (ProfileSlot) plan.stages[i].stage, start);
+            }
+            stripe.rowRange(top - from, bottom - from).copyTo(buffers->striped.rowRange(top, bottom));
+        }
+    }, count);
+    *frame = buffers->striped;
+    return true;
+}
+
+// Tile (x, y) of a frame of the given size, cut short at its right and bottom edges.
+static cv::Rect incrementalTile(cv::Size size, int x, int y) {
+    return cv::Rect(x * INCREMENTAL_TILE, y * INCREMENTAL_TILE, INCREMENTAL_TILE, INCREMENTAL_TILE) &
+           cv::Rect(0, 0, size.width, size.height);
+}
+
+// Marks the tiles with at least INCREMENTAL_SAMPLES samples (pixels times
+// channels) farther than the threshold from the reference, grown by the tiles
+// the halo reaches into. Counting over the tile itself, rather than averaging,
+// catches thin lines and small objects that move across an otherwise still tile.
+static void markDirtyTiles(const cv::Mat &source, int halo, IncrementalState *state) {
+    cv::Size grid(state->dirty.cols, state->dirty.rows);
+    cv::absdiff(source, state->reference, state->difference);
+    cv::threshold(state->difference, state->changed, INCREMENTAL_THRESHOLD, 255, cv::THRESH_BINARY);
+    for (int y = 0; y < grid.height; y++) {
+        uchar *dirty = state->dirty.ptr<uchar>(y);
+        for (int x = 0; x < grid.width; x++) {
+            cv::Mat tile = state->changed(incrementalTile(source.size(), x, y)).reshape(1);
+            dirty[x] = cv::countNonZero(tile) >= INCREMENTAL_SAMPLES;
+        }
+    }
+    int reach = (halo + INCREMENTAL_TILE - 1) / INCREMENTAL_TILE;
+    if (reach > 0) {
+        cv::dilate(state->dirty, state->dirty, cv::Mat::ones(2 * reach + 1, 2 * reach + 1, CV_8U));
+    }
+}
+
+// Runs stages[first, last) only on the tiles of *frame that changed since the
+// previous call, each with the halo around it, and leaves the others as they
+// were in the kept result. Everything is computed again whenever the plan or
+// the frame geometry changes. Returns false for frames it cannot compare.
+static bool applyIncremental(const ProcessingPlan &plan, int first, int last, cv::Mat *frame,
+                             FrameBuffers *buffers, Profiler *profiler) {
+    if (frame->depth() != CV_8U) return false;
+    int64 start = profileStart(profiler);
+    cv::Mat source = *frame;
+    IncrementalState *state = &buffers->incremental;
+    int halo = 0;
+    for (int i = first; i < last; i++) halo += plan.stages[i].halo;
+
+    cv::Size grid((source.cols + INCREMENTAL_TILE - 1) / INCREMENTAL_TILE,
+                  (source.rows + INCREMENTAL_TILE - 1) / INCREMENTAL_TILE);
+    bool stale = state->generation != plan.generation || state->reference.size() != source.size() ||
+                 state->reference.type() != source.type();
+    if (stale) {
+        state->generation = plan.generation;
+        source.copyTo(state->reference);
+        state->result.create(source.size(), stripedType(plan, first, last, source.type()));
+        state->dirty.create(grid, CV_8U);
+        state->dirty.setTo(cv::Scalar::all(1));
+    } else {
+        markDirtyTiles(source, halo, state);
+    }
+
+    state->tiles.clear();
+    for (int y = 0; y < grid.height; y++) {
+        const uchar *dirty = state->dirty.ptr<uchar>(y);
+        for (int x = 0; x < grid.width; x++) {
+            if (dirty[x]) state->tiles.push_back(incrementalTile(source.size(), x, y));
+        }
+    }
+
+    int workers = std::max(1, std::min((int) state->tiles.size(), cv::getNumThreads()));
+    if ((int) buffers->stripes.size() < workers) buffers->stripes.resize(workers);
+    cv::parallel_for_(cv::Range(0, workers), [&](const cv::Range &range) {
+        for (int w = range.start; w < range.end; w++) {
+            for (size_t t = w; t < state->tiles.size(); t += workers) {
+                const cv::Rect &tile = state->tiles[t];
+                cv::Rect padded = cv::Rect(tile.x - halo, tile.y - halo, tile.width + 2 * halo,
+                                           tile.height + 2 * halo) & cv::Rect(0, 0, source.cols, source.rows);
+                cv::Mat region = source(padded);
+                for (int i = first; i < last; i++) applyStage(plan, plan.stages[i], &region, &buffers->stripes[w]);
+                region(cv::Rect(tile.x - padded.x, tile.y - padded.y, tile.width, tile.height))
+                        .copyTo(state->result(tile));
+                if (!stale) source(tile).copyTo(state->reference(tile));
+            }
+        }
+    }, workers);
+
+    *frame = state->result;
+    profileEnd(profiler, PROFILE_TILES, start);
+    return true;
+}
+
+// the OpenCL backend already spreads each stage over the whole device
+static bool applyIncremental(const ProcessingPlan &, int, int, cv::UMat *, DeviceFrameBuffers *, Profiler *) {
+    return false;
+}
+
+// the OpenCL backend already spreads each stage over the whole device
+static bool applyStriped(const ProcessingPlan &, int, int, cv::UMat *, DeviceFrameBuffers *, Profiler *) {
+    return false;
+}
+
+// BGR to luma with the 15-bit fixed-point weights OpenCV 4's cv::cvtColor uses for 8-bit frames.
+static inline int grayOf(const uchar *bgr) {
+    return (bgr[0] * 3735 + bgr[1] * 19235 + bgr[2] * 9798 + (1 << 14)) >> 15;
+}
+
+// Grayscale and 2:1 halving of an even sized 8-bit BGR frame in one sweep,
+// rounding exactly like cv::cvtColor and cv::resize (which averages 2x2 blocks
+// at this scale) do when run one after the other, in either order.
+template<bool GrayFirst>
+static void fusedGrayHalve(const cv::Mat &src, cv::Mat *dst) {
+    dst->create(src.rows / 2, src.cols / 2, CV_8UC1);
+    cv::parallel_for_(cv::Range(0, dst->rows), [&](const cv::Range &rows) {
+        for (int y = rows.start; y < rows.end; y++) {
+            const uchar *top = src.ptr<uchar>(2 * y);
+            const uchar *bottom = src.ptr<uchar>(2 * y + 1);
+            uchar *out = dst->ptr<uchar>(y);
+            for (int x = 0; x < dst->cols; x++) {
+                const uchar *a = top + 6 * x;
+                const uchar *b = bottom + 6 * x;
+                if (GrayFirst) {
+                    out[x] = (uchar) ((grayOf(a) + grayOf(a + 3) + grayOf(b) + grayOf(b + 3) + 2) >> 2);
+                } else {
+                    uchar mean[3];
+                    for (int c = 0; c < 3; c++) mean[c] = (uchar) ((a[c] + a[c + 3] + b[c] + b[c + 3] + 2) >> 2);
+                    out[x] = (uchar) grayOf(mean);
+                }
+            }
+        }
+    });
+}
+
+constexpr bool fusesGrayHalve(Stage first, Stage second) {
+    return (first == STAGE_GRAYSCALE && (second == STAGE_HALVE || second == STAGE_GEOMETRY)) ||
+           (first == STAGE_HALVE && second == STAGE_GRAYSCALE);
+}
+
+// Whether the halving stage at index halves both axes and nothing else, on a frame the fused kernel takes.
+static bool canFuseGrayHalve(const ProcessingPlan &plan, int index, const cv::Mat &frame) {
+    const Geometry &geometry = plan.stages[index].stage == STAGE_GEOMETRY ? plan.geometry : plan.halving;
+    return geometry.halfSizeX && geometry.halfSizeY && !geometry.transpose && !geometry.flipRows &&
+           !geometry.flipCols && frame.type() == CV_8UC3 && frame.rows % 2 == 0 && frame.cols % 2 == 0;
+}
+
+template<Stage... Stages>
+struct StageSequence {};
+
+static void runFixed(StageSequence<>, const ProcessingPlan &, int, cv::Mat *, FrameBuffers *, Profiler *) {}
+
+template<Stage Last>
+static void runFixed(StageSequence<Last>, const ProcessingPlan &plan, int index, cv::Mat *frame,
+                     FrameBuffers *buffers, Profiler *profiler) {
+    int64 start = profileStart(profiler);
+    applyKernel(StageKernel<Last>(), plan, plan.stages[index], frame, buffers);
+    profileEnd(profiler, (ProfileSlot) Last, start);
+}
+
+// Unrolled at compile time, every stage calling its kernel directly and the
+// pairs that can be fused picked out there too.
+template<Stage First, Stage Second, Stage... Rest>
+static void runFixed(StageSequence<First, Second, Rest...>, const ProcessingPlan &plan, int index, cv::Mat *frame,
+                     FrameBuffers *buffers, Profiler *profiler) {
+    int halving = First == STAGE_GRAYSCALE ? index + 1 : index;
+    if (fusesGrayHalve(First, Second) && canFuseGrayHalve(plan, halving, *frame)) {
+        // timed as the first of the two
+        int64 start = profileStart(profiler);
+        fusedGrayHalve<First == STAGE_GRAYSCALE>(*frame, &buffers->halved);
+        *frame = buffers->halved;
+        profileEnd(profiler, (ProfileSlot) First, start);
+        runFixed(StageSequence<Rest...>(), plan, index + 2, frame, buffers, profiler);
+        return;
+    }
+    runFixed(StageSequence<First>(), plan, index, frame, buffers, profiler);
+    runFixed(StageSequence<Second, Rest...>(), plan, index + 1, frame, buffers, profiler);
+}
+
+typedef struct fixedPipeline {
+    int length;
+    Stage stages[MAX_STAGES];
+    void (*run)(const ProcessingPlan &plan, cv::Mat *frame, FrameBuffers *buffers, Profiler *profiler);
+} FixedPipeline;
+
+template<Stage... Stages>
+static FixedPipeline fixedPipeline() {
+    return {(int) sizeof...(Stages), {Stages...},
+            [](const ProcessingPlan &plan, cv::Mat *frame, FrameBuffers *buffers, Profiler *profiler) {
+                runFixed(StageSequence<Stages...>(), plan, 0, frame, buffers, profiler);
+            }};
+}
+
+// Stage lists that get a pipeline of their own, as orderStages produces them for
+// the combinations fixed deployments use: grayscale and halving, which run fused,
+// with Canny, the Gaussian or Sobel. Another one only needs a line here.
+static const FixedPipeline fixedPipelines[] = {
+        fixedPipeline<STAGE_GRAYSCALE, STAGE_GEOMETRY>(),
+        fixedPipeline<STAGE_HALVE, STAGE_GRAYSCALE, STAGE_CANNY>(),
+        fixedPipeline<STAGE_HALVE, STAGE_GRAYSCALE, STAGE_GAUSSIAN>(),
+        fixedPipeline<STAGE_HALVE, STAGE_GRAYSCALE, STAGE_GAUSSIAN, STAGE_CANNY>(),
+        fixedPipeline<STAGE_HALVE, STAGE_GRAYSCALE, STAGE_SOBEL>(),
+};
+
+static int findFixedPipeline(const ProcessingPlan &plan) {
+    if (plan.toggles.stripes > 1 || plan.toggles.incremental) return -1;
+    for (int i = 0; i < (int) (sizeof(fixedPipelines) / sizeof(fixedPipelines[0])); i++) {
+        const FixedPipeline &pipeline = fixedPipelines[i];
+        bool same = pipeline.length == plan.length;
+        for (int j = 0; same && j < plan.length; j++) same = pipeline.stages[j] == plan.stages[j].stage;
+        if (same) return i;
+    }
+    return -1;
+}
+
+static bool runFixedPipeline(const ProcessingPlan &plan, cv::Mat *frame, FrameBuffers *buffers, Profiler *profiler) {
+    if (plan.fixed < 0) return false;
+    fixedPipelines[plan.fixed].run(plan, frame, buffers, profiler);
+    return true;
+}
+
+// the device kernels are OpenCV's own
+static bool runFixedPipeline(const ProcessingPlan &, cv::UMat *, DeviceFrameBuffers *, Profiler *) {
+    return false;
+}
+
+template<typename M>
+void applyProcessing(Algorithms toggles, ProcessingParameters parameters, const M &input, M *frame,
+                     FrameBuffersOf<M> *buffers, Profiler *profiler) {
+    ProcessingPlan *plan = &buffers->plan;
+    if (!planMatches(*plan, toggles, parameters)) compilePlan(toggles, parameters, plan);
+
+    *frame = input;
+    if (runFixedPipeline(*plan, frame, buffers, profiler)) return;
+
+    bool incremental = plan->toggles.incremental;
+    for (int i = 0; i < plan->length; i++) {
+        // every local stage up to the next geometry goes through the tiles or the stripes at once
+        if ((incremental || plan->toggles.stripes > 1) && isLocalStage(plan->stages[i].stage)) {
+            int last = i;
+            while (last < plan->length && isLocalStage(plan->stages[last].stage)) last++;
+            bool done = incremental ? applyIncremental(*plan, i, last, frame, buffers, profiler)
+                                    : applyStriped(*plan, i, last, frame, buffers, profiler);
+            incremental = false; // the kept state belongs to the first run only
+            if (done) {
+                i = last - 1;
+                continue;
+            }
+        }
+
+        int64 start = profileStart(profiler);
+        applyStage(*plan, plan->stages[i], frame, buffers);
+        profileEnd(profiler, (ProfileSlot) plan->stages[i].stage, start);
+    }
+}
+
+template void applyPointChain<cv::Mat>(const PointChain &, const cv::Mat &, const cv::Mat &, cv::Mat *);
+
+template void applyPointChain<cv::UMat>(const PointChain &, const cv::UMat &, const cv::UMat &, cv::UMat *);
+
+template void applyGradient<cv::Mat>(const cv::Mat &, bool, bool, bool, cv::Mat *, GradientBuffersOf<cv::Mat> *);
+
+template void applyGradient<cv::UMat>(const cv::UMat &, bool, bool, bool, cv::UMat *, GradientBuffersOf<cv::UMat> *);
+
+template void applyBoxBlur<cv::Mat>(const cv::Mat &, cv::Mat *, cv::Mat *, cv::Size);
+
+template void applyBoxBlur<cv::UMat>(const cv::UMat &, cv::UMat *, cv::UMat *, cv::Size);
+
+template void applyGeometry<cv::Mat>(const Geometry &, const cv::Mat &, cv::Mat *, GeometryMaps *);
+
+template void applyGeometry<cv::UMat>(const Geometry &, const cv::UMat &, cv::UMat *, GeometryMapsOf<cv::UMat> *);
+
+template void applyProcessing<cv::Mat>(Algorithms, ProcessingParameters, const cv::Mat &, cv::Mat *, FrameBuffers *,
+                                       Profiler *);
+
+template void applyProcessing<cv::UMat>(Algorithms, ProcessingParameters, const cv::UMat &, cv::UMat *,
+                                        DeviceFrameBuffers *, Profiler *);
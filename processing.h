@@ -0,0 +1,289 @@
+#ifndef OVP_PROCESSING_H
+#define OVP_PROCESSING_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// How far stages may move away from the order they are written in, so the
+// expensive filters run on the smallest frame possible.
+typedef enum orderingTolerance {
+    ORDER_AS_WRITTEN,  // Gaussian, Canny, Sobel, point operations, grayscale, geometry
+    ORDER_EXACT,       // only moves that change pixels by rounding: grayscale ahead of a lone Gaussian,
+                       // halving ahead of grayscale, and dropping grayscale after Canny
+    ORDER_APPROXIMATE, // halving and grayscale always run first, grayscale even when off if the output
+                       // is Canny's single channel edge map anyway. Saturated pixels, Canny on luma instead
+                       // of on every channel and the Gaussian kernel halved along with the frame make
+                       // results differ visibly near edges
+    ORDER_COUNT
+} OrderingTolerance;
+
+typedef struct algorithms {
+    bool capture;
+    bool gaussian;
+    bool canny;
+    bool sobel;
+    bool brightness;
+    bool contrast;
+    bool negative;
+    bool grayscale;
+    bool halfSizeX;
+    bool halfSizeY;
+    int rotationsBy90;
+    bool mirrorX;
+    bool mirrorY;
+    bool record;
+    int ordering; // OrderingTolerance
+    bool profile; // overlay the stage timings on the processed window
+    int stripes;  // horizontal stripes the chain runs on in parallel, 0 or 1 for the whole frame at once
+    bool boxBlur; // approximate the Gaussian with box filters, whose cost does not depend on the kernel size
+    bool gradientL2;   // Sobel magnitude as sqrt(dx^2 + dy^2) instead of |dx| + |dy|
+    bool wideGradient; // 16-bit Sobel magnitude instead of saturating it to 8 bits
+    bool sharedGradient; // with Canny and Sobel both on, compute the gradient once and draw the edges over it
+    bool incremental;    // only filter the tiles that changed since the previous frame
+} Algorithms;
+
+typedef struct processingParameters {
+    int gaussianSize;
+    int cannyHighThreshold;
+    int brightness;
+    int contrast;
+} ProcessingParameters;
+
+// Per-pixel map y = saturate(alpha * x + beta), as done by cv::Mat::convertTo.
+typedef struct pointOperation {
+    double alpha;
+    double beta;
+} PointOperation;
+
+#define MAX_POINT_OPERATIONS 3
+
+// Consecutive point operations, fused into a single pass over the frame.
+typedef struct pointChain {
+    int length;
+    PointOperation operations[MAX_POINT_OPERATIONS];
+} PointChain;
+
+// Halving, rotation and mirroring reduced to one resampling: optional halving in
+// x and y, then an optional transpose, then optional flips of the rows and columns.
+// Any number of 90 degree rotations and mirrors is one element of the dihedral
+// group, which is always a transpose and/or a flip.
+typedef struct geometry {
+    bool halfSizeX;
+    bool halfSizeY;
+    bool transpose;
+    bool flipRows;
+    bool flipCols;
+} Geometry;
+
+// Remap tables for a geometry, rebuilt only when it or the source size changes.
+// M is cv::Mat or cv::UMat, like the frames they resample.
+template<typename M>
+struct GeometryMapsOf {
+    Geometry geometry;
+    cv::Size source;
+    M xy;
+    M weights;
+};
+
+typedef GeometryMapsOf<cv::Mat> GeometryMaps;
+
+// Derivatives of the Sobel stage, CV_16S for 8-bit frames and CV_32F otherwise,
+// and the float scratch of the path that does not fuse them.
+template<typename M>
+struct GradientBuffersOf {
+    M dx;
+    M dy;
+    M floatX;
+    M floatY;
+    M sum;
+};
+
+typedef enum stage {
+    STAGE_GAUSSIAN,
+    STAGE_CANNY,
+    STAGE_SOBEL,
+    STAGE_POINT,
+    STAGE_GRAYSCALE,
+    STAGE_HALVE,
+    STAGE_GEOMETRY,
+    STAGE_EDGES // Canny and Sobel sharing one gradient
+} Stage;
+
+#define MAX_STAGES 8
+
+// Enabled stages in execution order. geometry is what STAGE_GEOMETRY applies,
+// without the halving when STAGE_HALVE was split off to run earlier.
+typedef struct stageList {
+    int length;
+    Stage stages[MAX_STAGES];
+    Geometry geometry;
+} StageList;
+
+// Where the processing chain runs. The OpenCL backend keeps every frame in
+// cv::UMat device memory from capture to display.
+typedef enum backend {
+    BACKEND_CPU,
+    BACKEND_OPENCL
+} Backend;
+
+// One stage of a plan, with its settings worked out ahead of the frames.
+typedef struct plannedStage {
+    Stage stage;
+    cv::Size kernel; // of STAGE_GAUSSIAN, halved along with the frame when it runs after STAGE_HALVE
+    int halo;        // rows the stage reads past each side of a stripe
+} PlannedStage;
+
+// The stages toggles and parameters call for, compiled by applyProcessing and
+// reused for every frame until one of them changes.
+typedef struct processingPlan {
+    bool compiled;
+    Algorithms toggles;
+    ProcessingParameters parameters;
+    int length;
+    PlannedStage stages[MAX_STAGES];
+    Geometry geometry; // of STAGE_GEOMETRY, without the halving when STAGE_HALVE runs it
+    Geometry halving;  // of STAGE_HALVE
+    PointChain chain;
+    cv::Mat pointLut;  // the chain as a table for 8-bit frames, rebuilt only when the parameters change
+    double cannyHigh;
+    double cannyLow;
+    int fixed; // pipeline specialized for exactly these stages, -1 for the generic loop
+    long generation; // counts compilations, so state kept from earlier frames knows when it is stale
+} ProcessingPlan;
+
+// What toggles.incremental keeps from one frame to the next, for the first run
+// of local stages. Always on the host: the OpenCL backend processes whole frames.
+typedef struct incrementalState {
+    long generation;    // of the plan result was computed with
+    cv::Mat reference;  // run input each tile of result was last computed from
+    cv::Mat result;
+    cv::Mat difference;
+    cv::Mat changed;    // samples of difference above INCREMENTAL_THRESHOLD
+    cv::Mat dirty;      // one byte per tile
+    std::vector<cv::Rect> tiles;
+} IncrementalState;
+
+// Scratch frames of the stages. Every stage writes into its own buffer, which
+// OpenCV only reallocates when the frame geometry or type changes, so
+// steady-state processing does no allocation at all.
+template<typename M>
+struct StageBuffersOf {
+    M blurred;
+    M boxed; // intermediate pass of the box blur
+    M edges;
+    GradientBuffersOf<M> gradient;
+    M sobel;
+    M adjusted;
+    M gray;
+    M halved;
+    M transformed;
+    GeometryMapsOf<M> geometryMaps;
+    M pointLut; // the plan's table where the frames are, so OpenCL uploads it once per plan instead of every frame
+    long lutGeneration = 0; // of the plan pointLut was copied from
+};
+
+// Scratch frames owned by one caller of applyProcessing, plus one set per stripe
+// when toggles.stripes splits the frame.
+template<typename M>
+struct FrameBuffersOf : StageBuffersOf<M> {
+    std::vector<StageBuffersOf<M>> stripes;
+    M striped; // the stripes put back together
+    ProcessingPlan plan{}; // zeroed, so the first frame compiles it
+    IncrementalState incremental{};
+};
+
+typedef FrameBuffersOf<cv::Mat> FrameBuffers;
+typedef FrameBuffersOf<cv::UMat> DeviceFrameBuffers;
+
+// Routes cv::UMat work to the OpenCL device. Returns false when there is none.
+bool useBackend(Backend backend);
+
+// Gathers the enabled brightness, contrast and negative adjustments, in the order they apply.
+void collectPointOperations(Algorithms toggles, ProcessingParameters parameters, PointChain *chain);
+
+// Fills the 256-entry table of chain, which reproduces the saturation after every step exactly.
+void buildPointLut(const PointChain &chain, cv::Mat *lut);
+
+// Applies the whole chain in one sweep. 8-bit frames go through lut, as built by
+// buildPointLut, with integer lookups only; other depths use the composed alpha
+// and beta, which only saturates once at the end.
+template<typename M>
+void applyPointChain(const PointChain &chain, const M &lut, const M &src, M *dst);
+
+// Composes the halving, rotation and mirroring toggles into one geometry.
+Geometry composeGeometry(Algorithms toggles);
+
+bool isIdentityGeometry(const Geometry &geometry);
+
+// Size geometry turns a frame of the source size into.
+cv::Size geometrySize(const Geometry &geometry, cv::Size source);
+
+// Resamples src in one traversal: a plain resize or flip when that is all the
+// geometry needs, a single remap through cached tables otherwise.
+template<typename M>
+void applyGeometry(const Geometry &geometry, const M &src, M *dst, GeometryMapsOf<M> *maps);
+
+// Orders the enabled stages as allowed by toggles.ordering.
+void orderStages(Algorithms toggles, StageList *list);
+
+// Whether those stages reduce the frame to luma before anything but halving
+// looks at it, so a capture with a Y plane can hand that over instead.
+bool startsWithLuma(Algorithms toggles);
+
+typedef struct profiler Profiler;
+
+#define BOX_PASSES 3 // box filters in a row give a Gaussian within a few percent, each one a running sum
+
+// Widths of the BOX_PASSES box filters that together blur like a Gaussian
+// kernel of the given size, with the sigma cv::GaussianBlur derives from it.
+void boxBlurWidths(int size, int widths[BOX_PASSES]);
+
+// Blurs src with BOX_PASSES normalized box filters, ping-ponging between *dst and
+// *scratch. Costs the same for any kernel size.
+template<typename M>
+void applyBoxBlur(const M &src, M *dst, M *scratch, cv::Size size);
+
+#define GRADIENT_WIDE_SCALE 32 // 16-bit magnitudes are scaled by this, so that the 3x3 L1 maximum of 2040 fills 16 bits
+
+// 3x3 Sobel derivatives of src and their per-channel magnitude in a single sweep.
+// The magnitude is (|dx| + |dy|) / 2, or sqrt(dx^2 + dy^2) with l2, saturated to
+// 8 bits, or scaled by GRADIENT_WIDE_SCALE into 16 bits with wide. The
+// derivatives are kept in gradient->dx and dy when derivatives is set. 8-bit
+// frames on the CPU go through one fused loop, anything else through cv::Sobel.
+template<typename M>
+void applyGradient(const M &src, bool l2, bool wide, bool derivatives, M *magnitude, GradientBuffersOf<M> *gradient);
+
+#define STRIPE_MIN_ROWS 32 // stripes are never cut thinner than this or than their halo
+#define INCREMENTAL_TILE 64         // side of the tiles toggles.incremental compares and filters
+#define INCREMENTAL_THRESHOLD 12    // absolute difference above which a sample of a tile counts as changed
+#define INCREMENTAL_SAMPLES 3       // changed samples from which a tile is filtered again
+#define CANNY_HALO 4        // rows Canny reads past a stripe: 1 for Sobel, 1 for non-maximum suppression and some
+                            // slack for hysteresis, which is not local and may still differ along stripe seams
+
+// Works out the stages, kernels and tables toggles and parameters call for.
+void compilePlan(Algorithms toggles, ProcessingParameters parameters, ProcessingPlan *plan);
+
+// Whether plan was compiled from toggles and parameters that process frames the same way.
+bool planMatches(const ProcessingPlan &plan, Algorithms toggles, ProcessingParameters parameters);
+
+// Processes input and leaves in *frame a header to the result, which lives in
+// buffers (or is input itself when nothing is enabled) until the next call.
+// Every stage is timed into profiler unless it is nullptr. The plan kept in
+// buffers is only compiled again when toggles or parameters change. Stage lists
+// common in fixed deployments run through pipelines unrolled at compile time,
+// which fuse grayscale and halving into a single pass and call every other
+// stage's kernel without going through the switch over stages.
+// With toggles.stripes > 1 on the CPU, the filters and point operations run
+// stripe by stripe on separate cores, each stripe going through all of them while
+// it is still in cache, and the geometry then runs on the whole frame. Striped
+// stages are timed on the first stripe.
+// With toggles.incremental on the CPU, the first run of those stages only
+// processes the tiles where INCREMENTAL_SAMPLES samples of the input changed by
+// more than INCREMENTAL_THRESHOLD, and their neighbours within the halo, reusing
+// the previous result for the others. What it saves on a static scene is timed as PROFILE_TILES.
+// Instantiated for cv::Mat and, for the OpenCL backend, cv::UMat.
+template<typename M>
+void applyProcessing(Algorithms toggles, ProcessingParameters parameters, const M &input, M *frame,
+                     FrameBuffersOf<M> *buffers, Profiler *profiler = nullptr);
+
+#endif //OVP_PROCESSING_H
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include "profiler.h"
+
+static const char *slotNames[PROFILE_COUNT] = {
+        "gaussian", "canny", "sobel", "point", "grayscale", "halve", "geometry", "edges",
+        "capture", "display", "record", "latency", "tiles", "stream", "startup", "frame"
+};
+
+static double ticksToMs(int64 ticks) {
+    return 1000.0 * (double) ticks / cv::getTickFrequency();
+}
+
+void initProfiler(Profiler *profiler, bool tracing) {
+    std::lock_guard<std::mutex> lock(profiler->mutex);
+    profiler->origin = cv::getTickCount();
+    profiler->tracing = tracing;
+    memset(profiler->window, 0, sizeof(profiler->window));
+    memset(profiler->count, 0, sizeof(profiler->count));
+    memset(profiler->totalMs, 0, sizeof(profiler->totalMs));
+    memset(profiler->maxMs, 0, sizeof(profiler->maxMs));
+    memset(profiler->frameEnds, 0, sizeof(profiler->frameEnds));
+    profiler->trace.clear();
+    if (tracing) profiler->trace.reserve(PROFILE_TRACE_EVENTS);
+    profiler->shownFirst = false;
+}
+
+void profileFirstFrame(Profiler *profiler) {
+    if (profiler == nullptr) return;
+    {
+        std::lock_guard<std::mutex> lock(profiler->mutex);
+        if (profiler->shownFirst) return;
+        profiler->shownFirst = true;
+    }
+    profileEnd(profiler, PROFILE_STARTUP, profiler->origin);
+}
+
+int64 profileStart(Profiler *profiler) {
+    return profiler != nullptr ? cv::getTickCount() : 0;
+}
+
+void profileEnd(Profiler *profiler, ProfileSlot slot, int64 start) {
+    if (profiler == nullptr) return;
+    int64 end = cv::getTickCount();
+    double ms = ticksToMs(end - start);
+
+    std::lock_guard<std::mutex> lock(profiler->mutex);
+    long n = profiler->count[slot]++;
+    profiler->window[slot][n % PROFILE_WINDOW] = ms;
+    profiler->totalMs[slot] += ms;
+    if (ms > profiler->maxMs[slot]) profiler->maxMs[slot] = ms;
+    if (slot == PROFILE_FRAME) profiler->frameEnds[n % PROFILE_WINDOW] = end;
+
+    if (profiler->tracing && profiler->trace.size() < PROFILE_TRACE_EVENTS) {
+        int thread = (int) (std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000);
+        profiler->trace.push_back({slot, thread, start - profiler->origin, end - start});
+    }
+}
+
+const char *profileSlotName(int slot) {
+    return slot >= 0 && slot < PROFILE_COUNT ? slotNames[slot] : "unknown";
+}
+
+ProfileSummary summarizeProfile(Profiler *profiler, ProfileSlot slot) {
+    std::lock_guard<std::mutex> lock(profiler->mutex);
+    ProfileSummary summary = {profiler->count[slot], 0, 0, 0, profiler->maxMs[slot]};
+    if (summary.count == 0) return summary;
+
+    int samples = (int) std::min(summary.count, (long) PROFILE_WINDOW);
+    double sorted[PROFILE_WINDOW];
+    std::copy(profiler->window[slot], profiler->window[slot] + samples, sorted);
+    std::sort(sorted, sorted + samples);
+    summary.meanMs = profiler->totalMs[slot] / (double) summary.count;
+    summary.p50Ms = sorted[(samples - 1) / 2];
+    summary.p99Ms = sorted[(samples - 1) * 99 / 100];
+    return summary;
+}
+
+double profileFps(Profiler *profiler) {
+    std::lock_guard<std::mutex> lock(profiler->mutex);
+    long frames = profiler->count[PROFILE_FRAME];
+    if (frames < 2) return 0;
+    long last = frames - 1;
+    long first = std::max(0L, frames - PROFILE_WINDOW);
+    double seconds = (double) (profiler->frameEnds[last % PROFILE_WINDOW] -
+                               profiler->frameEnds[first % PROFILE_WINDOW]) / cv::getTickFrequency();
+    return seconds > 0 ? (double) (last - first) / seconds : 0;
+}
+
+void drawProfile(Profiler *profiler, cv::Mat &frame) {
+    std::vector<std::string> lines;
+    lines.push_back(cv::format("%.1f fps", profileFps(profiler)));
+    for (int slot = 0; slot < PROFILE_COUNT; slot++) {
+        ProfileSummary summary = summarizeProfile(profiler, (ProfileSlot) slot);
+        if (summary.count == 0) continue;
+        lines.push_back(cv::format("%-9s p50 %6.2f  p99 %6.2f ms", slotNames[slot], summary.p50Ms, summary.p99Ms));
+    }
+
+    cv::Scalar color = frame.channels() == 1 ? cv::Scalar(255) : cv::Scalar(0, 255, 0);
+    for (size_t i = 0; i < lines.size(); i++) {
+        cv::Point origin(8, 18 + 16 * (int) i);
+        cv::putText(frame, lines[i], origin, cv::FONT_HERSHEY_PLAIN, 1.0, cv::Scalar::all(0), 3, cv::LINE_AA);
+        cv::putText(frame, lines[i], origin, cv::FONT_HERSHEY_PLAIN, 1.0, color, 1, cv::LINE_AA);
+    }
+}
+
+bool exportProfile(Profiler *profiler, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) return false;
+
+    size_t length = strlen(path);
+    bool csv = length >= 4 && strcmp(path + length - 4, ".csv") == 0;
+    if (csv) {
+        fprintf(file, "stage,count,mean_ms,p50_ms,p99_ms,max_ms\n");
+    } else {
+        fprintf(file, "{\n  \"fps\": %.3f,\n  \"stages\": {", profileFps(profiler));
+    }
+
+    bool first = true;
+    for (int slot = 0; slot < PROFILE_COUNT; slot++) {
+        ProfileSummary s = summarizeProfile(profiler, (ProfileSlot) slot);
+        if (s.count == 0) continue;
+        if (csv) {
+            fprintf(file, "%s,%ld,%.4f,%.4f,%.4f,%.4f\n", slotNames[slot], s.count, s.meanMs, s.p50Ms, s.p99Ms,
+                    s.maxMs);
+        } else {
+            fprintf(file, "%s\n    \"%s\": {\"count\": %ld, \"mean_ms\": %.4f, \"p50_ms\": %.4f, "
+                          "\"p99_ms\": %.4f, \"max_ms\": %.4f}",
+                    first ? "" : ",", slotNames[slot], s.count, s.meanMs, s.p50Ms, s.p99Ms, s.maxMs);
+        }
+        first = false;
+    }
+
+    if (!csv) fprintf(file, "\n  }\n}\n");
+    return fclose(file) == 0;
+}
+
+bool exportTrace(Profiler *profiler, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) return false;
+
+    std::lock_guard<std::mutex> lock(profiler->mutex);
+    double ticksPerUs = cv::getTickFrequency() / 1e6;
+    fprintf(file, "{\"traceEvents\": [");
+    for (size_t i = 0; i < profiler->trace.size(); i++) {
+        const ProfileEvent &event = profiler->trace[i];
+        fprintf(file, "%s\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.1f, \"dur\": %.1f}",
+                i == 0 ? "" : ",", slotNames[event.slot], event.thread, (double) event.start / ticksPerUs,
+                (double) event.duration / ticksPerUs);
+    }
+    fprintf(file, "\n], \"displayTimeUnit\": \"ms\"}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,88 @@
+#ifndef OVP_PROFILER_H
+#define OVP_PROFILER_H
+
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "processing.h"
+
+// Timed sections of the frame loop. The processing stages keep their Stage value.
+typedef enum profileSlot {
+    PROFILE_GAUSSIAN = STAGE_GAUSSIAN,
+    PROFILE_CANNY = STAGE_CANNY,
+    PROFILE_SOBEL = STAGE_SOBEL,
+    PROFILE_POINT = STAGE_POINT,
+    PROFILE_GRAYSCALE = STAGE_GRAYSCALE,
+    PROFILE_HALVE = STAGE_HALVE,
+    PROFILE_GEOMETRY = STAGE_GEOMETRY,
+    PROFILE_EDGES = STAGE_EDGES,
+    PROFILE_CAPTURE,
+    PROFILE_DISPLAY,
+    PROFILE_RECORD,
+    PROFILE_LATENCY, // from grabbing a frame to showing it processed
+    PROFILE_TILES,   // the stages toggles.incremental runs tile by tile
+    PROFILE_STREAM,  // handing a batch of frames to the network, on the stream's own thread
+    PROFILE_STARTUP, // from initProfiler to the first processed frame on screen, once
+    PROFILE_FRAME, // whole iteration of the loop that shows or writes the frames
+    PROFILE_COUNT
+} ProfileSlot;
+
+#define PROFILE_WINDOW 256          // samples per slot behind the rolling percentiles
+#define PROFILE_TRACE_EVENTS 200000 // events kept for the Chrome trace, later ones are dropped
+
+typedef struct profileEvent {
+    int slot;
+    int thread;
+    int64 start;
+    int64 duration;
+} ProfileEvent;
+
+typedef struct profileSummary {
+    long count;
+    double meanMs;
+    double p50Ms;
+    double p99Ms;
+    double maxMs;
+} ProfileSummary;
+
+// Per-slot timings shared by every thread of the frame loop.
+typedef struct profiler {
+    std::mutex mutex;
+    int64 origin;
+    bool tracing;
+    double window[PROFILE_COUNT][PROFILE_WINDOW]; // latest durations in ms, circular
+    long count[PROFILE_COUNT];
+    double totalMs[PROFILE_COUNT];
+    double maxMs[PROFILE_COUNT];
+    int64 frameEnds[PROFILE_WINDOW]; // end of the latest frames, for the rolling FPS
+    std::vector<ProfileEvent> trace;
+    bool shownFirst; // PROFILE_STARTUP was recorded
+} Profiler;
+
+void initProfiler(Profiler *profiler, bool tracing);
+
+// Records PROFILE_STARTUP on the first call, after the first processed frame was shown.
+void profileFirstFrame(Profiler *profiler);
+
+// Start of a timed section; 0 when profiler is nullptr.
+int64 profileStart(Profiler *profiler);
+
+void profileEnd(Profiler *profiler, ProfileSlot slot, int64 start);
+
+const char *profileSlotName(int slot);
+
+ProfileSummary summarizeProfile(Profiler *profiler, ProfileSlot slot);
+
+// Frames per second over the latest PROFILE_WINDOW frames.
+double profileFps(Profiler *profiler);
+
+// Draws FPS and the p50/p99 of every slot seen so far in the top left corner.
+void drawProfile(Profiler *profiler, cv::Mat &frame);
+
+// Summary per slot as CSV when path ends in ".csv", JSON otherwise.
+bool exportProfile(Profiler *profiler, const char *path);
+
+// Every recorded section in the Chrome trace event format (chrome://tracing, Perfetto).
+bool exportTrace(Profiler *profiler, const char *path);
+
+#endif //OVP_PROFILER_H
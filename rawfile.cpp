@@ -0,0 +1,176 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "rawfile.h"
+
+bool isRawPath(const char *path) {
+    size_t length = strlen(path);
+    return length >= 4 && strcmp(path + length - 4, ".raw") == 0;
+}
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// retries until everything is written
+static bool writeAt(int fd, const void *data, size_t size, off_t offset) {
+    auto bytes = (const char *) data;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+bool openRawWriter(RawWriter *writer, const char *path, cv::Size size, int type, double fps) {
+    RawHeader *header = &writer->header;
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, RAW_MAGIC, sizeof(header->magic));
+    header->width = size.width;
+    header->height = size.height;
+    header->type = type;
+    header->rowBytes = (uint64_t) size.width * CV_ELEM_SIZE(type);
+    header->stride = (header->rowBytes * size.height + RAW_PAGE - 1) / RAW_PAGE * RAW_PAGE;
+    header->fps = fps;
+
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) return false;
+    if (!writeAt(writer->fd, header, sizeof(*header), 0)) {
+        close(writer->fd);
+        writer->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool writeRawFrame(RawWriter *writer, const cv::Mat &frame) {
+    RawHeader *header = &writer->header;
+    if (frame.cols != header->width || frame.rows != header->height || frame.type() != header->type) return false;
+    off_t offset = (off_t) (RAW_PAGE + header->count * header->stride);
+    if (frame.isContinuous()) {
+        if (!writeAt(writer->fd, frame.data, header->rowBytes * frame.rows, offset)) return false;
+    } else {
+        for (int y = 0; y < frame.rows; y++) {
+            if (!writeAt(writer->fd, frame.ptr(y), header->rowBytes, offset + y * header->rowBytes)) return false;
+        }
+    }
+    header->count++;
+    return true;
+}
+
+void closeRawWriter(RawWriter *writer) {
+    if (writer->fd < 0) return;
+    // the padding of the last frame is a hole, but it belongs to the file for the mapping
+    if (ftruncate(writer->fd, (off_t) (RAW_PAGE + writer->header.count * writer->header.stride)) != 0 ||
+        !writeAt(writer->fd, &writer->header, sizeof(writer->header), 0)) {
+        fprintf(stderr, "could not finish the raw dump: %s\n", strerror(errno));
+    }
+    close(writer->fd);
+    writer->fd = -1;
+}
+
+// Whether header describes frames that fit the stride it gives them, so no
+// frame wrapped around the mapping reads past its end.
+static bool validHeader(const RawHeader &header) {
+    if (memcmp(header.magic, RAW_MAGIC, sizeof(header.magic)) != 0) return false;
+    if (header.width <= 0 || header.height <= 0 || header.type < 0 || header.type != CV_MAT_TYPE(header.type)) {
+        return false;
+    }
+    uint64_t pixels = (uint64_t) header.width * CV_ELEM_SIZE(header.type);
+    return header.rowBytes >= pixels && header.rowBytes % CV_ELEM_SIZE1(header.type) == 0 && header.stride > 0 &&
+           header.rowBytes <= header.stride / header.height;
+}
+
+bool openRawReplay(RawReplay *replay, const char *path) {
+    replay->data = nullptr;
+    replay->position = 0;
+    replay->fd = open(path, O_RDONLY);
+    struct stat file;
+    if (replay->fd < 0 || fstat(replay->fd, &file) != 0) {
+        fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+        closeRawReplay(replay);
+        return false;
+    }
+
+    replay->length = (size_t) file.st_size;
+    RawHeader *header = &replay->header;
+    if (replay->length < RAW_PAGE || pread(replay->fd, header, sizeof(*header), 0) != (ssize_t) sizeof(*header) ||
+        !validHeader(*header)) {
+        fprintf(stderr, "%s is not a raw dump\n", path);
+        closeRawReplay(replay);
+        return false;
+    }
+    replay->count = (long) ((replay->length - RAW_PAGE) / header->stride);
+    if (header->count > 0 && (long) header->count < replay->count) replay->count = (long) header->count;
+
+    void *data = mmap(nullptr, replay->length, PROT_READ, MAP_PRIVATE, replay->fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "could not map %s: %s\n", path, strerror(errno));
+        closeRawReplay(replay);
+        return false;
+    }
+    replay->data = (const uchar *) data;
+    madvise(data, replay->length, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool rawFrame(const RawReplay *replay, long index, cv::Mat *frame) {
+    if (index < 0 || index >= replay->count) return false;
+    const RawHeader &header = replay->header;
+    auto start = (uchar *) replay->data + RAW_PAGE + index * header.stride;
+    *frame = cv::Mat(header.height, header.width, header.type, start, header.rowBytes);
+    return true;
+}
+
+bool nextRawFrame(RawReplay *replay, cv::Mat *frame) {
+    if (!rawFrame(replay, replay->position, frame)) return false;
+    replay->position++;
+    return true;
+}
+
+void closeRawReplay(RawReplay *replay) {
+    if (replay->data != nullptr) munmap((void *) replay->data, replay->length);
+    replay->data = nullptr;
+    if (replay->fd >= 0) close(replay->fd);
+    replay->fd = -1;
+}
+
+#else
+
+bool openRawWriter(RawWriter *writer, const char *, cv::Size, int, double) {
+    writer->fd = -1;
+    fprintf(stderr, "raw dumps are written with pwrite and replayed with mmap, which only the Linux build uses\n");
+    return false;
+}
+
+bool writeRawFrame(RawWriter *, const cv::Mat &) {
+    return false;
+}
+
+void closeRawWriter(RawWriter *) {}
+
+bool openRawReplay(RawReplay *replay, const char *) {
+    replay->fd = -1;
+    replay->data = nullptr;
+    replay->count = 0;
+    fprintf(stderr, "raw dumps are written with pwrite and replayed with mmap, which only the Linux build uses\n");
+    return false;
+}
+
+bool rawFrame(const RawReplay *, long, cv::Mat *) {
+    return false;
+}
+
+bool nextRawFrame(RawReplay *, cv::Mat *) {
+    return false;
+}
+
+void closeRawReplay(RawReplay *) {}
+
+#endif
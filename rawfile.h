@@ -0,0 +1,63 @@
+#ifndef OVP_RAWFILE_H
+#define OVP_RAWFILE_H
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+#define RAW_MAGIC "OVPRAW01"
+#define RAW_PAGE 4096 // the header takes one, and every frame starts at a multiple of it
+
+// Fixed-stride dump of frames of one size and type, exactly as the chain saw
+// or produced them. Frame i starts at RAW_PAGE + i * stride, so the header is
+// the whole index and any frame is reached without reading the others.
+typedef struct rawHeader {
+    char magic[8];
+    int32_t width;
+    int32_t height;
+    int32_t type;      // cv::Mat type of every frame
+    int32_t reserved;
+    uint64_t rowBytes;
+    uint64_t stride;   // bytes from one frame to the next, whole pages
+    uint64_t count;    // frames, updated when the writer closes
+    double fps;
+} RawHeader;
+
+typedef struct rawWriter {
+    int fd = -1;
+    RawHeader header;
+} RawWriter;
+
+// Maps a whole dump read-only. Frames are headers over the mapping, so replay
+// neither decodes nor copies, and a stage writing into its input would fault.
+typedef struct rawReplay {
+    int fd = -1;
+    const uchar *data;
+    size_t length;
+    RawHeader header;
+    long count;     // frames actually in the file, which a writer that never closed leaves behind the header
+    long position;  // next frame nextRawFrame returns
+} RawReplay;
+
+// Whether path names a dump rather than a video: it ends in .raw.
+bool isRawPath(const char *path);
+
+bool openRawWriter(RawWriter *writer, const char *path, cv::Size size, int type, double fps);
+
+// Appends frame, which must have the size and type the writer was opened with.
+bool writeRawFrame(RawWriter *writer, const cv::Mat &frame);
+
+// Writes the final frame count into the header.
+void closeRawWriter(RawWriter *writer);
+
+// Prints the problem and returns false when path is not a readable dump.
+bool openRawReplay(RawReplay *replay, const char *path);
+
+// Points *frame at frame index of the mapping. Returns false past the end.
+bool rawFrame(const RawReplay *replay, long index, cv::Mat *frame);
+
+// Same for the frame at replay->position, moving it on by one.
+bool nextRawFrame(RawReplay *replay, cv::Mat *frame);
+
+void closeRawReplay(RawReplay *replay);
+
+#endif //OVP_RAWFILE_H
@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <cstring>
+#include "recorder.h"
+
+RecorderSettings defaultRecorderSettings() {
+    return {"footage.avi", ENCODER_DEFAULT, cv::VideoWriter::fourcc('X', 'V', 'I', 'D'), 0, 0, nullptr};
+}
+
+double recordingFps(const RecorderSettings &settings, cv::VideoCapture &cap) {
+    if (settings.fps > 0) return settings.fps;
+    double fps = cap.get(cv::CAP_PROP_FPS);
+    return fps > 0 ? fps : RECORDER_FPS;
+}
+
+std::string numberedPath(const std::string &path, int index) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%03d", index);
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+static bool endsWith(const std::string &text, const char *suffix) {
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+static std::string gstreamerPipeline(const RecorderSettings &settings, const std::string &path) {
+    std::string encoder;
+    std::string presetProperty;
+    switch (settings.encoder) {
+        case ENCODER_NVENC:
+            encoder = "nvh264enc";
+            presetProperty = "preset";
+            break;
+        case ENCODER_VAAPI:
+            encoder = "vaapih264enc";
+            presetProperty = "quality-level";
+            break;
+        case ENCODER_QSV:
+            encoder = "qsvh264enc";
+            presetProperty = "target-usage";
+            break;
+        default:
+            encoder = "x264enc";
+            presetProperty = "speed-preset";
+            break;
+    }
+    if (settings.bitrate > 0) encoder += " bitrate=" + std::to_string(settings.bitrate);
+    if (settings.preset != nullptr) encoder += " " + presetProperty + "=" + settings.preset;
+
+    std::string muxer = endsWith(path, ".mp4") ? "mp4mux" : endsWith(path, ".avi") ? "avimux" : "matroskamux";
+    return "appsrc ! videoconvert ! " + encoder + " ! h264parse ! " + muxer + " ! filesink location=" + path;
+}
+
+int recordedType(const std::string &path, int type) {
+    return isRawPath(path.c_str()) ? type : CV_8UC3;
+}
+
+// VideoWriter takes acceleration properties from OpenCV 4.5.2 on
+#define OVP_WRITER_PROPERTIES (CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && (CV_VERSION_MINOR > 5 || \
+                               (CV_VERSION_MINOR == 5 && CV_VERSION_REVISION >= 2))))
+
+static bool openVideo(cv::VideoWriter &writer, const RecorderSettings &settings, const std::string &path,
+                      cv::Size size, double fps) {
+    switch (settings.encoder) {
+        case ENCODER_DEFAULT:
+            return writer.open(path, settings.fourcc, fps, size, true);
+
+        case ENCODER_FFMPEG_HW:
+#if OVP_WRITER_PROPERTIES
+            return writer.open(path, cv::CAP_FFMPEG, settings.fourcc, fps, size,
+                               {cv::VIDEOWRITER_PROP_HW_ACCELERATION, cv::VIDEO_ACCELERATION_ANY});
+#else
+            fprintf(stderr, "hardware encoding needs OpenCV 4.5.2 or later, encoding with FFmpeg in software\n");
+            return writer.open(path, cv::CAP_FFMPEG, settings.fourcc, fps, size, true);
+#endif
+
+        default:
+            // the GStreamer backend takes the pipeline in place of the file name and no fourcc
+            return writer.open(gstreamerPipeline(settings, path), cv::CAP_GSTREAMER, 0, fps, size, true);
+    }
+}
+
+bool openWriter(FrameWriter &writer, const RecorderSettings &settings, const std::string &path, cv::Size size,
+                int type, double fps) {
+    writer.dumping = isRawPath(path.c_str());
+    if (writer.dumping) return openRawWriter(&writer.raw, path.c_str(), size, type, fps);
+    return openVideo(writer.video, settings, path, size, fps);
+}
+
+bool isWriterOpen(const FrameWriter &writer) {
+    return writer.dumping ? writer.raw.fd >= 0 : writer.video.isOpened();
+}
+
+void closeWriter(FrameWriter &writer) {
+    closeRawWriter(&writer.raw);
+    writer.video.release();
+}
+
+void recordFrame(FrameWriter &writer, cv::InputArray frame, cv::Mat *bgr) {
+    if (writer.dumping) {
+        if (!writeRawFrame(&writer.raw, frame.getMat())) fprintf(stderr, "could not write a raw frame\n");
+    } else if (frame.depth() == CV_16U) {
+        frame.getMat().convertTo(*bgr, CV_8U, 1.0 / 256);
+        if (bgr->channels() == 1) cv::cvtColor(*bgr, *bgr, cv::COLOR_GRAY2BGR);
+        writer.video.write(*bgr);
+    } else if (frame.channels() == 1) {
+        cv::cvtColor(frame, *bgr, cv::COLOR_GRAY2BGR);
+        writer.video.write(*bgr);
+    } else {
+        writer.video.write(frame);
+    }
+}
+
+// Opens the writer for the first frame, and a new numbered file whenever the size or recorded type changes.
+static bool prepareWriter(AsyncRecorder *recorder, cv::Size size, int type) {
+    type = recordedType(recorder->settings.path, type);
+    if (recorder->files > 0 && recorder->size == size && recorder->type == type) {
+        return isWriterOpen(recorder->writer); // no retry on failure
+    }
+
+    closeWriter(recorder->writer);
+    std::string path = recorder->files == 0 ? recorder->settings.path
+                                            : numberedPath(recorder->settings.path, recorder->files);
+    recorder->files++;
+    recorder->size = size;
+    recorder->type = type;
+    if (openWriter(recorder->writer, recorder->settings, path, size, type, recorder->fps)) return true;
+    fprintf(stderr, "could not open %s for recording\n", path.c_str());
+    return false;
+}
+
+static void encoderLoop(AsyncRecorder *recorder) {
+    cv::Mat frame;
+    cv::Mat bgr;
+    while (recorder->queue->pop(frame)) {
+        int64 start = profileStart(recorder->profiler);
+        if (prepareWriter(recorder, frame.size(), frame.type())) recordFrame(recorder->writer, frame, &bgr);
+        profileEnd(recorder->profiler, PROFILE_RECORD, start);
+    }
+    closeWriter(recorder->writer);
+}
+
+void startRecorder(AsyncRecorder *recorder, const RecorderSettings &settings, double fps, size_t capacity,
+                   OverflowPolicy policy, Profiler *profiler) {
+    recorder->settings = settings;
+    recorder->fps = fps;
+    recorder->files = 0;
+    recorder->profiler = profiler;
+    recorder->queue.reset(new RingBuffer<cv::Mat>(capacity, policy));
+}
+
+void submitFrame(AsyncRecorder *recorder, cv::InputArray frame) {
+    // most sessions never record, and those that do pay for the encoder once they start
+    if (!recorder->thread.joinable()) recorder->thread = std::thread(encoderLoop, recorder);
+    frame.copyTo(recorder->pending);
+    recorder->queue->push(recorder->pending);
+}
+
+void stopRecorder(AsyncRecorder *recorder) {
+    if (!recorder->thread.joinable()) return;
+    recorder->queue->close();
+    recorder->thread.join();
+}
+
+long droppedFrames(AsyncRecorder *recorder) {
+    return recorder->queue->droppedCount();
+}
@@ -0,0 +1,97 @@
+#ifndef OVP_RECORDER_H
+#define OVP_RECORDER_H
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "ringbuffer.h"
+#include "profiler.h"
+#include "rawfile.h"
+
+#define RECORDER_QUEUE 32 // frames waiting for the encoder before the overflow policy applies
+#define RECORDER_FPS 32.0 // when neither the settings nor the source give one
+
+typedef enum encoder {
+    ENCODER_DEFAULT,   // OpenCV's default backend with settings.fourcc
+    ENCODER_FFMPEG_HW, // FFmpeg backend with whatever hardware acceleration it finds (VAAPI, QSV...)
+    ENCODER_X264,      // the GStreamer encoders below honour bitrate and preset
+    ENCODER_NVENC,
+    ENCODER_VAAPI,
+    ENCODER_QSV
+} Encoder;
+
+typedef struct recorderSettings {
+    const char *path;
+    Encoder encoder;
+    int fourcc;         // codec of ENCODER_DEFAULT and ENCODER_FFMPEG_HW
+    double fps;         // 0 to use the source frame rate
+    int bitrate;        // kbit/s, 0 for the encoder default
+    const char *preset; // x264 speed-preset, NVENC preset, QSV target-usage or VAAPI quality-level
+} RecorderSettings;
+
+// An encoder, or for paths ending in .raw a dump of the frames exactly as they
+// are, with neither conversion nor compression, own type and all.
+typedef struct frameWriter {
+    cv::VideoWriter video;
+    RawWriter raw;
+    bool dumping = false;
+} FrameWriter;
+
+// Encodes on a background thread fed by a bounded queue, so the loop that
+// captures and displays never waits for the encoder. The writer is opened with
+// the size of the first frame; when the processed size changes (halving,
+// rotation), or the type of frames a dump takes does, recording continues in
+// the next numbered file.
+typedef struct asyncRecorder {
+    RecorderSettings settings;
+    double fps;
+    FrameWriter writer;
+    cv::Size size;
+    int type; // of the frames written as they are, CV_8UC3 for the encoders
+    int files;
+    std::unique_ptr<RingBuffer<cv::Mat>> queue;
+    std::thread thread;
+    cv::Mat pending; // buffer handed to the queue on the next submit
+    Profiler *profiler;
+} AsyncRecorder;
+
+RecorderSettings defaultRecorderSettings();
+
+// Frame rate to record cap at: the configured one, the source's, or RECORDER_FPS.
+double recordingFps(const RecorderSettings &settings, cv::VideoCapture &cap);
+
+// "out.avi", 3 -> "out_003.avi"
+std::string numberedPath(const std::string &path, int index);
+
+// Type frames of the given type are written as: their own in a dump, 8-bit BGR for
+// the encoders.
+int recordedType(const std::string &path, int type);
+
+// Opens writer on path with the encoder, bitrate and preset of settings, or as a
+// dump of frames of type when path ends in .raw.
+bool openWriter(FrameWriter &writer, const RecorderSettings &settings, const std::string &path, cv::Size size,
+                int type, double fps);
+
+bool isWriterOpen(const FrameWriter &writer);
+
+void closeWriter(FrameWriter &writer);
+
+// Writes frame, expanding single-channel frames to BGR and 16-bit ones to 8 bits
+// through the reusable *bgr buffer unless it goes to a dump.
+void recordFrame(FrameWriter &writer, cv::InputArray frame, cv::Mat *bgr);
+
+// Sets the recorder up without touching the encoder: the thread is only started,
+// and the file only opened, with the first submitted frame.
+void startRecorder(AsyncRecorder *recorder, const RecorderSettings &settings, double fps, size_t capacity,
+                   OverflowPolicy policy, Profiler *profiler);
+
+// Queues a copy of frame, which may be reused as soon as this returns.
+void submitFrame(AsyncRecorder *recorder, cv::InputArray frame);
+
+// Encodes whatever is still queued, then stops the thread and closes the file.
+void stopRecorder(AsyncRecorder *recorder);
+
+long droppedFrames(AsyncRecorder *recorder);
+
+#endif //OVP_RECORDER_H
@@ -0,0 +1,101 @@
+#ifndef OVP_RINGBUFFER_H
+#define OVP_RINGBUFFER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// What push does when the buffer is full.
+typedef enum overflowPolicy {
+    OVERFLOW_BLOCK,       // wait for the consumer
+    OVERFLOW_DROP_OLDEST, // discard the oldest pending item to make room
+    OVERFLOW_DROP_NEWEST  // discard the item being pushed
+} OverflowPolicy;
+
+// Bounded FIFO joining two pipeline threads. Items are swapped in and out of
+// the slots, so the buffers they own circulate between producer and consumer
+// instead of being reallocated.
+template<typename T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity, OverflowPolicy policy = OVERFLOW_BLOCK)
+            : slots(capacity), policy(policy), head(0), tail(0), count(0), dropped(0), closed(false) {}
+
+    // Applies the overflow policy while full. Returns false if the buffer was closed.
+    bool push(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (policy == OVERFLOW_BLOCK) {
+            notFull.wait(lock, [this] { return count < slots.size() || closed; });
+        }
+        if (closed) return false;
+        if (count == slots.size()) {
+            dropped++;
+            if (policy == OVERFLOW_DROP_NEWEST) return true;
+            // when full the head is also the oldest slot, whose buffer ends up recycled into item
+            tail = (tail + 1) % slots.size();
+            count--;
+        }
+        std::swap(slots[head], item);
+        head = (head + 1) % slots.size();
+        count++;
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while empty. Returns false once closed and drained.
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return count > 0 || closed; });
+        if (count == 0) return false;
+        std::swap(slots[tail], item);
+        tail = (tail + 1) % slots.size();
+        count--;
+        notFull.notify_one();
+        return true;
+    }
+
+    // Never blocks. Returns false when there is nothing to pop.
+    bool tryPop(T &item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == 0) return false;
+        std::swap(slots[tail], item);
+        tail = (tail + 1) % slots.size();
+        count--;
+        notFull.notify_one();
+        return true;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+
+    // Items discarded by the overflow policy so far.
+    long droppedCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    }
+
+    // Wakes every waiter; pending items can still be popped.
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    std::vector<T> slots;
+    OverflowPolicy policy;
+    size_t head;
+    size_t tail;
+    size_t count;
+    long dropped;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
+
+#endif //OVP_RINGBUFFER_H
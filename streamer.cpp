@@ -0,0 +1,200 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "streamer.h"
+
+bool parseStreamTarget(const char *url, StreamSender *sender) {
+    std::string target = url;
+    if (target.compare(0, 6, "tcp://") == 0) sender->protocol = STREAM_TCP;
+    else if (target.compare(0, 6, "rtp://") == 0) sender->protocol = STREAM_RTP;
+    else {
+        fprintf(stderr, "streams go to tcp://host:port or rtp://host:port, not '%s'\n", url);
+        return false;
+    }
+    size_t colon = target.find_last_of(':');
+    int port = colon > 6 ? atoi(target.c_str() + colon + 1) : 0;
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "no port in '%s'\n", url);
+        return false;
+    }
+#ifndef __linux__
+    if (sender->protocol == STREAM_TCP) {
+        fprintf(stderr, "tcp:// streams are sent with sendmsg, which only the Linux build uses\n");
+        return false;
+    }
+#endif
+    sender->host = target.substr(6, colon - 6);
+    sender->port = port;
+    return true;
+}
+
+#ifdef __linux__
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static int connectTo(const std::string &host, int port) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *found;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) return -1;
+
+    int fd = -1;
+    for (addrinfo *address = found; address != nullptr && fd < 0; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0) return -1;
+
+    // every batch is one call already, so waiting to fill a segment would only add latency
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// Writes all the parts, resuming where a partial send stopped.
+static bool sendParts(int fd, iovec *parts, int count) {
+    while (count > 0) {
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = parts;
+        message.msg_iovlen = count;
+        ssize_t written = sendmsg(fd, &message, MSG_NOSIGNAL); // a closed socket is an error, not a signal
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        while (count > 0 && (size_t) written >= parts->iov_len) {
+            written -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = (char *) parts->iov_base + written;
+            parts->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// Sends every frame of the batch, headers and pixels, in a single call, so the
+// kernel cuts them into full segments instead of one short packet per write.
+static bool sendTcp(StreamSender *sender, const StreamItem *batch, int count) {
+    if (sender->fd < 0) {
+        int64 now = cv::getTickCount();
+        if (sender->attempted != 0 && now - sender->attempted < STREAM_RETRY * cv::getTickFrequency()) return false;
+        sender->attempted = now;
+        sender->fd = connectTo(sender->host, sender->port);
+        if (sender->fd < 0) return false;
+        printf("streaming to %s:%d\n", sender->host.c_str(), sender->port);
+    }
+
+    StreamFrameHeader headers[STREAM_QUEUE];
+    iovec parts[2 * STREAM_QUEUE];
+    for (int i = 0; i < count; i++) {
+        const cv::Mat &frame = batch[i].frame; // continuous, as copyTo allocated it
+        headers[i] = {STREAM_MAGIC, frame.cols, frame.rows, frame.type(), batch[i].grabbed,
+                      (uint64_t) (frame.total() * frame.elemSize())};
+        parts[2 * i] = {&headers[i], sizeof(headers[i])};
+        parts[2 * i + 1] = {frame.data, (size_t) headers[i].bytes};
+    }
+    if (sendParts(sender->fd, parts, 2 * count)) return true;
+
+    fprintf(stderr, "lost the stream to %s:%d: %s\n", sender->host.c_str(), sender->port, strerror(errno));
+    close(sender->fd);
+    sender->fd = -1;
+    return false;
+}
+
+static void disconnect(StreamSender *sender) {
+    if (sender->fd >= 0) close(sender->fd);
+    sender->fd = -1;
+}
+
+#else
+
+// parseStreamTarget refuses TCP targets here
+static bool sendTcp(StreamSender *, const StreamItem *, int) {
+    return false;
+}
+
+static void disconnect(StreamSender *) {}
+
+#endif
+
+static std::string rtpPipeline(const StreamSender *sender) {
+    return "appsrc ! videoconvert ! x264enc tune=zerolatency speed-preset=ultrafast key-int-max=30"
+           " ! rtph264pay config-interval=1 pt=96 ! udpsink host=" + sender->host +
+           " port=" + std::to_string(sender->port) + " sync=false";
+}
+
+// RTP packs each encoded frame itself, so frames go to the encoder one by one.
+static bool sendRtp(StreamSender *sender, const StreamItem *batch, int count) {
+    for (int i = 0; i < count; i++) {
+        const cv::Mat &frame = batch[i].frame;
+        if (frame.size() != sender->size) {
+            closeWriter(sender->rtp);
+            sender->size = frame.size();
+            sender->rtp.dumping = false;
+            if (!sender->rtp.video.open(rtpPipeline(sender), cv::CAP_GSTREAMER, 0, sender->fps, frame.size(), true)) {
+                fprintf(stderr, "could not start the RTP stream to %s:%d\n", sender->host.c_str(), sender->port);
+            }
+        }
+        if (!isWriterOpen(sender->rtp)) return false;
+        recordFrame(sender->rtp, frame, &sender->bgr);
+    }
+    return true;
+}
+
+static void sendLoop(StreamSender *sender) {
+    StreamItem batch[STREAM_QUEUE];
+    while (sender->queue->pop(batch[0])) {
+        // whatever queued up while the last batch was on its way leaves together
+        int count = 1;
+        while (count < STREAM_QUEUE && sender->queue->tryPop(batch[count])) count++;
+
+        int64 start = profileStart(sender->profiler);
+        bool sent = sender->protocol == STREAM_RTP ? sendRtp(sender, batch, count) : sendTcp(sender, batch, count);
+        profileEnd(sender->profiler, PROFILE_STREAM, start);
+        if (sent) sender->sent += count;
+        else sender->failed += count;
+    }
+    closeWriter(sender->rtp);
+    disconnect(sender);
+}
+
+void startStream(StreamSender *sender, double fps, Profiler *profiler) {
+    sender->fps = fps;
+    sender->fd = -1;
+    sender->attempted = 0;
+    sender->size = cv::Size();
+    sender->sent = 0;
+    sender->failed = 0;
+    sender->profiler = profiler;
+    sender->queue.reset(new RingBuffer<StreamItem>(STREAM_QUEUE, OVERFLOW_DROP_OLDEST));
+    sender->thread = std::thread(sendLoop, sender);
+}
+
+void streamFrame(StreamSender *sender, cv::InputArray frame, int64 grabbed) {
+    frame.copyTo(sender->pending.frame);
+    sender->pending.grabbed = grabbed;
+    sender->queue->push(sender->pending);
+}
+
+void stopStream(StreamSender *sender) {
+    if (!sender->thread.joinable()) return;
+    sender->queue->close();
+    sender->thread.join();
+}
+
+long droppedStreamFrames(StreamSender *sender) {
+    return sender->queue->droppedCount();
+}
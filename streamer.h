@@ -0,0 +1,75 @@
+#ifndef OVP_STREAMER_H
+#define OVP_STREAMER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "profiler.h"
+#include "recorder.h"
+#include "ringbuffer.h"
+
+#define STREAM_QUEUE 4            // frames the sender may fall behind by before the oldest is dropped
+#define STREAM_RETRY 1.0          // seconds between attempts to reach a server that is not there
+#define STREAM_MAGIC 0x4650564f   // "OVPF" in little endian, starts every frame on the TCP stream
+
+typedef enum streamProtocol {
+    STREAM_TCP, // frames as they are, each behind a StreamFrameHeader
+    STREAM_RTP  // H.264 over RTP/UDP, encoded by GStreamer on the sender thread
+} StreamProtocol;
+
+// Precedes every frame sent over TCP, followed by height rows of width pixels of type.
+typedef struct streamFrameHeader {
+    uint32_t magic;
+    int32_t width;
+    int32_t height;
+    int32_t type;     // cv::Mat type
+    int64_t grabbed;  // tick count the frame was captured at, on the sender's clock
+    uint64_t bytes;   // of pixels that follow
+} StreamFrameHeader;
+
+typedef struct streamItem {
+    cv::Mat frame;
+    int64 grabbed;
+} StreamItem;
+
+// Ships processed frames to a monitoring server from a thread of its own, fed
+// by a bounded queue that drops the oldest frame when the network falls
+// behind, so a slow or absent viewer never holds up the processing. Drops and
+// failed sends are counted; the time each send takes is PROFILE_STREAM.
+typedef struct streamSender {
+    StreamProtocol protocol;
+    std::string host;
+    int port;
+    double fps;     // the RTP encoder is told
+    int fd;         // TCP connection, -1 while there is none
+    int64 attempted; // tick count of the last attempt to connect
+    FrameWriter rtp;
+    cv::Size size; // the RTP encoder was opened with
+    cv::Mat bgr;
+    std::unique_ptr<RingBuffer<StreamItem>> queue;
+    std::thread thread;
+    StreamItem pending; // buffer handed to the queue on the next submit
+    long sent;
+    long failed;    // frames lost to a missing or broken connection
+    Profiler *profiler;
+} StreamSender;
+
+// Understands tcp://host:port and rtp://host:port. Prints the problem and
+// returns false on anything else.
+bool parseStreamTarget(const char *url, StreamSender *sender);
+
+// Starts the sender thread for a target parsed by parseStreamTarget. It
+// connects on its own, so a server that is not up yet only costs frames.
+void startStream(StreamSender *sender, double fps, Profiler *profiler);
+
+// Queues a copy of frame, which may be reused as soon as this returns.
+void streamFrame(StreamSender *sender, cv::InputArray frame, int64 grabbed);
+
+// Sends whatever is still queued, then stops the thread and closes the connection.
+void stopStream(StreamSender *sender);
+
+long droppedStreamFrames(StreamSender *sender);
+
+#endif //OVP_STREAMER_H
@@ -0,0 +1,76 @@
+#include "threadpool.h"
+
+// index of the pool worker running on this thread, -1 elsewhere
+static thread_local int workerIndex = -1;
+
+ThreadPool::ThreadPool(int workers) : pending(0), nextQueue(0), stopping(false) {
+    if (workers < 1) workers = 1;
+    for (int i = 0; i < workers; i++) queues.emplace_back(new TaskQueue());
+    for (int i = 0; i < workers; i++) threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads) thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    int index = workerIndex >= 0 ? workerIndex : (int) (nextQueue++ % queues.size());
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        pending++;
+    }
+    wake.notify_one();
+}
+
+int ThreadPool::size() const {
+    return (int) threads.size();
+}
+
+bool ThreadPool::takeTask(int index, std::function<void()> *task) {
+    {
+        TaskQueue &own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            *task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        TaskQueue &victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int index) {
+    workerIndex = index;
+    std::function<void()> task;
+    while (true) {
+        if (takeTask(index, &task)) {
+            pending--;
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        // pending may count a task another worker is about to take, which only costs one more look
+        wake.wait(lock, [this] { return pending > 0 || stopping; });
+        if (stopping && pending <= 0) return;
+    }
+}
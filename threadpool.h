@@ -0,0 +1,48 @@
+#ifndef OVP_THREADPOOL_H
+#define OVP_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers with one deque each. A worker runs its own tasks newest
+// first and, when it runs out, steals the oldest task of another worker, so
+// uneven streams still keep every core busy without more threads than cores.
+class ThreadPool {
+public:
+    explicit ThreadPool(int workers);
+
+    // Runs every task already submitted, then joins the workers.
+    ~ThreadPool();
+
+    // From a worker the task goes to its own deque, from any other thread the
+    // deques are filled round robin.
+    void submit(std::function<void()> task);
+
+    int size() const;
+
+private:
+    typedef struct taskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    } TaskQueue;
+
+    void workerLoop(int index);
+
+    bool takeTask(int index, std::function<void()> *task);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<long> pending;
+    std::atomic<unsigned> nextQueue;
+    bool stopping;
+};
+
+#endif //OVP_THREADPOOL_H
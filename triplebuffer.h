@@ -0,0 +1,40 @@
+#ifndef OVP_TRIPLEBUFFER_H
+#define OVP_TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Latest value handed from one writer thread to one reader thread without locks.
+// Each side owns a slot and they trade through the third with a single atomic
+// exchange, so publish and read never wait for each other and the reader always
+// sees a whole value, never half of an update. T must be copyable.
+template<typename T>
+class TripleBuffer {
+public:
+    explicit TripleBuffer(const T &initial) : slots{initial, initial, initial}, back(0), front(1), middle(2) {}
+
+    // Writer side.
+    void publish(const T &value) {
+        slots[back] = value;
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Reader side. The latest published value, or the one read last if nothing
+    // was published since. The reference stays valid until the next read.
+    const T &read() {
+        if (middle.load(std::memory_order_relaxed) & FRESH) {
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        }
+        return slots[front];
+    }
+
+private:
+    static const int INDEX = 3;
+    static const int FRESH = 4; // set while the middle slot holds a value the reader has not taken
+
+    T slots[3];
+    int back;  // only touched by the writer
+    int front; // only touched by the reader
+    std::atomic<int> middle;
+};
+
+#endif //OVP_TRIPLEBUFFER_H